@@ -126,11 +126,12 @@ pg3:
 .org 0x5000
 /*
  * tmp_floppy_area is used by the floppy-driver when DMA cannot
- * reach to a buffer-block. It needs to be aligned, so that it isn't
+ * reach to a buffer-block, and to cache a whole cylinder (2 tracks
+ * of at most 18 sectors). It needs to be aligned, so that it isn't
  * on a 64kB border.
  */
 _tmp_floppy_area:
-	.fill 1024,1,0
+	.fill 18432,1,0
 
 after_page_tables:
 	pushl $0		# These are the parameters to main :-)
@@ -19,6 +19,8 @@
  */
 
 #include <stdarg.h>
+#include <errno.h>
+#include <sys/stat.h>
  
 #include <linux/config.h>
 #include <linux/sched.h>
@@ -28,9 +30,20 @@
 
 extern int end;	// 由链接器生成，指明内核执行模块的末端位置
 struct buffer_head * start_buffer = (struct buffer_head *) &end;		// 缓冲区开始地址
-struct buffer_head * hash_table[NR_HASH];								// 缓冲区Hash表
-static struct buffer_head * free_list;									// 空闲列表
+struct buffer_head ** hash_table;										// 缓冲区Hash表 buffer_init()中分配
+static int nr_hash = 0;													// hash表桶数 2的幂
+static int hash_shift = 32;												// 32-log2(nr_hash)
+static unsigned long hash_lookups = 0;									// find_buffer()调用次数
+static unsigned long hash_probes = 0;									// 查找时比较过的缓冲块总数
+static unsigned long ra_issued = 0;										// 发出预读的块数
+static unsigned long ra_hits = 0;										// 预读块在被回收前被使用
+static unsigned long ra_misses = 0;										// 预读块未被使用就被回收
+extern int * blk_size[];
+extern char * rd_map(int dev, int block);
+static struct buffer_head * lru_list[NR_LIST];							// 未使用缓冲块的lru链表
+static int nr_buffers_type[NR_LIST] = {0, };							// 各lru链表中的缓冲块数
 static struct task_struct * buffer_wait = NULL;							// 等待空闲缓冲区的任务队列
+static struct task_struct * bdflush_wait = NULL;						// bdflush睡眠的地方
 int NR_BUFFERS = 0;														// 系统含有缓冲块个数
 
 /// 等待指定缓冲区解锁 如果被锁住，就睡眠
@@ -43,23 +56,99 @@ static inline void wait_on_buffer(struct buffer_head * bh)
 	sti();
 }
 
+// 按设备号和块号排序的比较
+#define BUF_BEFORE(a,b) ((a)->b_dev < (b)->b_dev || \
+((a)->b_dev == (b)->b_dev && (a)->b_blocknr < (b)->b_blocknr))
+
+/// 对缓冲块指针数组按(设备,块号)排序 shell排序
+static void sort_buffers(struct buffer_head ** list, int nr)
+{
+	struct buffer_head * tmp;
+	int gap,i,j;
+
+	for (gap = nr/2 ; gap > 0 ; gap /= 2)
+		for (i = gap ; i < nr ; i++)
+			for (j = i-gap ; j >= 0 && BUF_BEFORE(list[j+gap],list[j]) ;
+			     j -= gap) {
+				tmp = list[j];
+				list[j] = list[j+gap];
+				list[j+gap] = tmp;
+			}
+}
+
+static inline void get_buffer(struct buffer_head * bh);
+
+/// 等写出的缓冲块写完并释放它 返回写是否失败
+static int wait_written(struct buffer_head * bh)
+{
+	int err;
+
+	wait_on_buffer(bh);
+	err = !bh->b_uptodate;
+	brelse(bh);
+	return err;
+}
+
+/*
+ * Write out the dirty buffers of 'dev' (of all devices if dev is 0).
+ * They are gathered a page-full at a time and sorted by device and
+ * block, so that ll_rw_cluster() can send runs of contiguous blocks as
+ * single requests. Without a free page we do it the old way, one
+ * buffer at a time in buffer order.
+ *
+ * With 'wait' set, the buffers are held while written, and waited for:
+ * the number of them that failed is returned.
+ */
+/// 把设备dev（0表示所有设备）的脏缓冲块按块号顺序写盘
+static int write_dirty_buffers(int dev, int wait)
+{
+	struct buffer_head ** list, * bh;
+	int i,j,nr,err = 0;
+
+	if (!(list = (struct buffer_head **) get_free_page())) {
+		bh = start_buffer;
+		for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
+			if (dev && bh->b_dev != dev)
+				continue;
+			wait_on_buffer(bh);
+			// 下面需要再判断一次设备，可能是因为再等待后，该缓冲块被其他进程使用
+			if ((!dev || bh->b_dev == dev) && bh->b_dirt) {
+				if (wait)
+					get_buffer(bh);
+				ll_rw_block(WRITE,bh);
+				if (wait)
+					err += wait_written(bh);
+			}
+		}
+		return err;
+	}
+	bh = start_buffer;
+	i = 0;
+	while (i < NR_BUFFERS) {
+		for (nr = 0 ; i<NR_BUFFERS && nr<PAGE_SIZE/sizeof(bh) ; i++,bh++)
+			if (bh->b_dirt && (!dev || bh->b_dev == dev)) {
+				if (wait)
+					get_buffer(bh);
+				list[nr++] = bh;
+			}
+		sort_buffers(list,nr);
+		ll_rw_cluster(WRITE,nr,list);
+		if (wait)
+			for (j = 0 ; j < nr ; j++)
+				err += wait_written(list[j]);
+	}
+	free_page((unsigned long) list);
+	return err;
+}
+
 /// 设备数据同步
 //	同步设备和内存高速缓冲区中数据
 //	同步会把所有修改过的i节点写入高速缓冲
 //	然后把高速缓冲区写入设备中，这里是产生设备块写请求
 int sys_sync(void)
 {
-	int i;
-	struct buffer_head * bh;
-
 	sync_inodes();		/* write out inodes into buffers */
-	bh = start_buffer;
-	/// 便利缓冲块，有脏标记就写入设备中
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		wait_on_buffer(bh);		// 等待缓冲区可用
-		if (bh->b_dirt)
-			ll_rw_block(WRITE,bh);
-	}
+	write_dirty_buffers(0,0);
 	return 0;
 }
 
@@ -68,31 +157,48 @@ int sys_sync(void)
 //	然后同步inode，在把设定设备的缓冲区写盘
 int sync_dev(int dev)
 {
-	int i;
-	struct buffer_head * bh;
-
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		// 下面需要再判断一次设备，可能是因为再等待后，该缓冲块被其他进程使用
-		if (bh->b_dev == dev && bh->b_dirt)
-			ll_rw_block(WRITE,bh);
-	}
+	write_dirty_buffers(dev,0);
 	/// 再次同步
 	sync_inodes();
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_dirt)
-			ll_rw_block(WRITE,bh);
-	}
+	write_dirty_buffers(dev,0);
 	return 0;
 }
 
+/*
+ * Like sync_dev(), but waits for the writes, and then has the drive
+ * write its cache to the medium, and waits for that too. Returns -EIO
+ * if a write or the flush failed.
+ */
+/// 同步设备 并等待数据确实写到了介质上
+int fsync_dev(int dev)
+{
+	int err;
+
+	err = write_dirty_buffers(dev,1);
+	sync_inodes();
+	err += write_dirty_buffers(dev,1);
+	if (ll_rw_flush(dev) || err)
+		return -EIO;
+	return 0;
+}
+
+/// 把文件所在设备的数据同步到介质上
+int sys_fsync(unsigned int fd)
+{
+	struct file * file;
+	struct m_inode * inode;
+	int dev;
+
+	if (fd >= NR_OPEN || !(file = current->filp[fd]) ||
+	    !(inode = file->f_inode))
+		return -EBADF;
+	if (S_ISBLK(inode->i_mode))
+		dev = inode->i_zone[0];
+	else if (inode->i_pipe || !(dev = inode->i_dev))
+		return -EINVAL;
+	return fsync_dev(dev);
+}
+
 /// 使指定设备的高速缓冲区数据无效
 //	扫描所有缓冲区，是属于设备的缓冲区的更新标记和脏标记置0
 //	这个是什么时候用呢？卸载设备的时候？
@@ -143,14 +249,100 @@ void check_disk_change(int dev)
 	invalidate_buffers(dev);
 }
 
+/*
+ * Multiplicative hash: the device goes into the high half so that the
+ * same block numbers on different devices don't collide, and the top
+ * bits of the product are used as the bucket index.
+ */
 // hash函数计算
-#define _hashfn(dev,block) (((unsigned)(dev^block))%NR_HASH)
+#define _hashfn(dev,block) \
+((((((unsigned long)(dev))<<16) ^ (unsigned long)(block)) * 0x9E370001UL) \
+	>> hash_shift)
 #define hash(dev,block) hash_table[_hashfn(dev,block)]
 
-/// 从hash队列和空闲缓冲队列中移走缓冲区
-static inline void remove_from_queues(struct buffer_head * bh)
+/*
+ * bdflush writes a dirty buffer back once it has been dirty for BDF_AGE
+ * ticks, or all of them whenever more than BDF_RATIO percent of the
+ * cache is dirty. It looks every BDF_INTERVAL ticks, and getblk()/
+ * brelse() kick it earlier when clean buffers start to run out.
+ */
+#define BDF_INTERVAL	(5*HZ)
+#define BDF_AGE		(30*HZ)
+#define BDF_RATIO	40
+
+#define TOO_MANY_DIRTY() \
+(nr_buffers_type[BUF_DIRTY]*100 > NR_BUFFERS*BDF_RATIO)
+
+/*
+ * The lru-lists only ever hold buffers nobody is using (b_count == 0),
+ * sorted by the state they had when they were released. Interrupts may
+ * unlock a buffer or the sync-code may write it out while it sits on a
+ * list, so the lists are only hints: whoever finds a buffer on the wrong
+ * list just refiles it. That keeps interrupt routines away from the lists.
+ */
+/// 计算缓冲块应该在的lru链表
+static inline int buffer_list(struct buffer_head * bh)
+{
+	if (bh->b_lock)
+		return BUF_LOCKED;
+	if (bh->b_dirt)
+		return BUF_DIRTY;
+	return BUF_CLEAN;
+}
+
+/// 从所在lru链表中移除 （不在链表中则什么都不做）
+static inline void remove_from_lru(struct buffer_head * bh)
+{
+	if (!bh->b_next_free)
+		return;
+	if (!bh->b_prev_free)
+		panic("Free block list corrupted");
+	nr_buffers_type[bh->b_list]--;
+	if (bh->b_next_free == bh)
+		lru_list[bh->b_list] = NULL;
+	else {
+		bh->b_prev_free->b_next_free = bh->b_next_free;
+		bh->b_next_free->b_prev_free = bh->b_prev_free;
+		if (lru_list[bh->b_list] == bh)
+			lru_list[bh->b_list] = bh->b_next_free;
+	}
+	bh->b_prev_free = bh->b_next_free = NULL;
+}
+
+/// 放入对应lru链表的末尾 无效数据的块放在链表头，优先被重用
+static inline void put_last_lru(struct buffer_head * bh)
+{
+	struct buffer_head ** head;
+
+	bh->b_list = buffer_list(bh);
+	if (bh->b_list != BUF_DIRTY)
+		bh->b_flushtime = 0;
+	else if (!bh->b_flushtime)
+		bh->b_flushtime = jiffies + BDF_AGE;
+	nr_buffers_type[bh->b_list]++;
+	head = lru_list + bh->b_list;
+	if (!*head) {
+		*head = bh->b_next_free = bh->b_prev_free = bh;
+		return;
+	}
+	bh->b_next_free = *head;
+	bh->b_prev_free = (*head)->b_prev_free;
+	(*head)->b_prev_free->b_next_free = bh;
+	(*head)->b_prev_free = bh;
+	if (!bh->b_uptodate)
+		*head = bh;
+}
+
+/// 缓冲块状态已变，重新放到正确的lru链表中
+static inline void refile_buffer(struct buffer_head * bh)
+{
+	remove_from_lru(bh);
+	put_last_lru(bh);
+}
+
+/// 从hash队列中移走缓冲区
+static inline void remove_from_hash(struct buffer_head * bh)
 {
-/* remove from hash-queue */
 	if (bh->b_next)
 		bh->b_next->b_prev = bh->b_prev;
 	if (bh->b_prev)
@@ -158,24 +350,12 @@ static inline void remove_from_queues(struct buffer_head * bh)
 	// 维护hash头
 	if (hash(bh->b_dev,bh->b_blocknr) == bh)
 		hash(bh->b_dev,bh->b_blocknr) = bh->b_next;
-
-/* remove from free list */
-	if (!(bh->b_prev_free) || !(bh->b_next_free))
-		panic("Free block list corrupted");
-	bh->b_prev_free->b_next_free = bh->b_next_free;
-	bh->b_next_free->b_prev_free = bh->b_prev_free;
-	if (free_list == bh)
-		free_list = bh->b_next_free;
+	bh->b_prev = bh->b_next = NULL;
 }
 
-/// 插入到hash链表体系中
-static inline void insert_into_queues(struct buffer_head * bh)
+/// 插入到hash链表中
+static inline void insert_into_hash(struct buffer_head * bh)
 {
-/* put at end of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
 /* put the buffer in new hash-queue if it has a device */
 	bh->b_prev = NULL;
 	bh->b_next = NULL;
@@ -183,7 +363,8 @@ static inline void insert_into_queues(struct buffer_head * bh)
 		return;
 	bh->b_next = hash(bh->b_dev,bh->b_blocknr);
 	hash(bh->b_dev,bh->b_blocknr) = bh;
-	bh->b_next->b_prev = bh;
+	if (bh->b_next)
+		bh->b_next->b_prev = bh;
 }
 
 /// 在hash表中找到指定设备+块号的高速缓冲区
@@ -191,12 +372,112 @@ static struct buffer_head * find_buffer(int dev, int block)
 {		
 	struct buffer_head * tmp;
 
-	for (tmp = hash(dev,block) ; tmp != NULL ; tmp = tmp->b_next)
+	hash_lookups++;
+	for (tmp = hash(dev,block) ; tmp != NULL ; tmp = tmp->b_next) {
+		hash_probes++;
 		if (tmp->b_dev==dev && tmp->b_blocknr==block)
 			return tmp;
+	}
 	return NULL;
 }
 
+/// 引用计数加一，第一个使用者把它从lru链表中拿走
+static inline void get_buffer(struct buffer_head * bh)
+{
+	if (!bh->b_count++)
+		remove_from_lru(bh);
+}
+
+/// 引用计数减一，不等待解锁。最后一个使用者把它放回lru链表
+static inline void put_buffer(struct buffer_head * bh)
+{
+	if (!(bh->b_count--))
+		panic("Trying to free free buffer");
+	if (!bh->b_count) {
+		if (bh->b_mapped)
+			bh->b_dirt = 0;		/* it is on the ram disk already */
+		else
+			put_last_lru(bh);
+	}
+}
+
+/*
+ * Blocks of the ram disk aren't copied into the cache: their buffers
+ * point right at the ram disk, so they are always up to date, and there
+ * is never anything to write. They have no data of their own, come from
+ * pages of their own, and once made stay in the hash table for good,
+ * off the lru-lists. If there's no page for them, the ram disk just
+ * goes through the cache like any other device.
+ */
+static struct buffer_head * free_mapped = NULL;
+
+/// 为虚拟盘的块做一个直接指向虚拟盘的缓冲块 不能做返回NULL
+static struct buffer_head * get_mapped(int dev, int block)
+{
+	struct buffer_head * bh;
+	unsigned long page;
+	char * data;
+	int i;
+
+	if (!(data = rd_map(dev,block)))
+		return NULL;
+	if (!free_mapped) {
+		if (!(page = get_free_page()))
+			return NULL;
+		bh = (struct buffer_head *) page;
+		for (i = PAGE_SIZE/sizeof(struct buffer_head) ; i > 0 ; i--,bh++) {
+			bh->b_next_free = free_mapped;
+			free_mapped = bh;
+		}
+	}
+	bh = free_mapped;
+	free_mapped = bh->b_next_free;
+	bh->b_data = data;
+	bh->b_dev = dev;
+	bh->b_blocknr = block;
+	bh->b_uptodate = 1;
+	bh->b_dirt = 0;
+	bh->b_count = 1;
+	bh->b_lock = 0;
+	bh->b_list = BUF_CLEAN;
+	bh->b_reada = 0;
+	bh->b_mapped = 1;
+	bh->b_flushtime = 0;
+	bh->b_wait = NULL;
+	bh->b_prev_free = bh->b_next_free = NULL;
+	bh->b_reqnext = NULL;
+	bh->b_end_io = NULL;
+	bh->b_private = NULL;
+	insert_into_hash(bh);
+	return bh;
+}
+
+/*
+ * Write a dirty buffer together with the dirty blocks that surround it
+ * on the device, as far as they are in the cache: a single request
+ * instead of one per buffer. Used when buffers are written one by one
+ * (getblk() evicting, bdflush aging them out).
+ */
+/// 把bh和与它相邻的脏块一起写盘
+static void write_cluster(struct buffer_head * bh)
+{
+	struct buffer_head * list[MAX_CLUSTER], * tmp;
+	int first,nr;
+
+	for (first = bh->b_blocknr ; bh->b_blocknr - first < MAX_CLUSTER-1 &&
+	     first > 0 ; first--)
+		if (!(tmp = find_buffer(bh->b_dev,first-1)) || !tmp->b_dirt)
+			break;
+	for (nr = 0 ; nr < MAX_CLUSTER ; nr++) {
+		if (first+nr == bh->b_blocknr)
+			tmp = bh;
+		else if (!(tmp = find_buffer(bh->b_dev,first+nr)) || !tmp->b_dirt)
+			break;
+		list[nr] = tmp;
+	}
+	ll_rw_cluster(WRITE,nr,list);
+}
+
 /*
  * Why like this, I hear you say... The reason is race-conditions.
  * As we don't lock buffers (unless we are readint them, that is),
@@ -214,11 +495,51 @@ struct buffer_head * get_hash_table(int dev, int block)
 	for (;;) {
 		if (!(bh=find_buffer(dev,block)))
 			return NULL;
-		bh->b_count++;	// 这里为啥要维护引用呢
+		get_buffer(bh);	// 这里为啥要维护引用呢
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_blocknr == block)
+		if (bh->b_dev == dev && bh->b_blocknr == block) {
+			if (bh->b_reada) {		// 第一次使用预读进来的块
+				bh->b_reada = 0;
+				if (bh->b_uptodate)
+					ra_hits++;
+			}
 			return bh;
-		bh->b_count--;
+		}
+		put_buffer(bh);
+	}
+}
+
+/*
+ * Pick the buffer getblk() should reuse. Clean buffers are taken from
+ * the head of the clean list, i.e. the least recently released one.
+ * Only if there are none do we fall back to a dirty buffer (which has
+ * to be written first) and then to one with I/O still in flight. Every
+ * buffer that is looked at is either returned or refiled, so this is
+ * constant time apart from the refiling, which is paid for only once
+ * per state change.
+ */
+/// 选择一个可重用的缓冲块 优先级：干净 > 脏 > 锁住 都没有返回NULL
+static struct buffer_head * get_lru_victim(void)
+{
+	struct buffer_head * bh;
+
+	for (;;) {
+		/* I/O completes roughly in submission order */
+		while ((bh = lru_list[BUF_LOCKED]) && !bh->b_lock)
+			refile_buffer(bh);
+		if (bh = lru_list[BUF_CLEAN]) {
+			if (buffer_list(bh) == BUF_CLEAN)
+				return bh;
+			refile_buffer(bh);
+			continue;
+		}
+		if (bh = lru_list[BUF_DIRTY]) {
+			if (buffer_list(bh) == BUF_DIRTY)
+				return bh;
+			refile_buffer(bh);
+			continue;
+		}
+		return lru_list[BUF_LOCKED];
 	}
 }
 
@@ -228,46 +549,34 @@ struct buffer_head * get_hash_table(int dev, int block)
  * so it should be much more efficient than it looks.
  *
  * The algoritm is changed: hopefully better, and an elusive bug removed.
+ * Victims now come off the lru-lists instead of a scan of all buffers.
  */
- // 定义搜索时需要的比较值  同时也规定了优先级，dirt要高
-#define BADNESS(bh) (((bh)->b_dirt<<1)+(bh)->b_lock)
-
-
 /// 根据设备号和逻辑块号，获取一个缓冲区块，且引用计数会加一.
-//  如果hash表中没有指向该key的缓冲区，则找一个空闲的，把key设置成(dev,block)（会先从hash表中移除，再添加）
-//	并返回。所以此方法应该不返回空的？？
+//  如果hash表中没有指向该key的缓冲区，则从lru链表取一个空闲的，把key设置成(dev,block)
+//	并返回。没有空闲的就睡眠等待，所以此方法不返回空
 struct buffer_head * getblk(int dev,int block)
 {
-	struct buffer_head * tmp, * bh;
+	struct buffer_head * bh;
    
 repeat:
 	// 先从hash表中获取，可能为空
 	if (bh = get_hash_table(dev,block))
 		return bh;
-	tmp = free_list;
-	do {
-		if (tmp->b_count)	// 引用计数不等于0，有进程在使用
-			continue;
-		if (!bh || BADNESS(tmp)<BADNESS(bh)) {
-			bh = tmp;
-			if (!BADNESS(tmp))
-				// 从到这里表示 tmp既没有被锁住，也不是脏的，更没有被其他进程所拿住
-				// 就可以跳出返回
-				break;
-		}
-/* and repeat until we find something good */
-	} while ((tmp = tmp->b_next_free) != free_list);
-	if (!bh) {
-		// 没找到，等待
+	// 虚拟盘的块直接用虚拟盘的内存
+	if (MAJOR(dev) == 1 && (bh = get_mapped(dev,block)))
+		return bh;
+	if (!(bh = get_lru_victim())) {
+		// 所有缓冲块都在使用中，等待
 		sleep_on(&buffer_wait);
 		goto repeat;
 	}
 	wait_on_buffer(bh); // 保证没被锁住
 	if (bh->b_count)	// 再次保证没有引用
 		goto repeat;
-	// 又有脏数据
+	// 又有脏数据 只写回这一块，其余的交给bdflush
 	while (bh->b_dirt) {
-		sync_dev(bh->b_dev); // 同步到设备中
+		wake_up(&bdflush_wait);
+		write_cluster(bh);
 		wait_on_buffer(bh);	// 保证没锁 没引用
 		if (bh->b_count)
 			goto repeat;
@@ -280,13 +589,19 @@ repeat:
 /* OK, FINALLY we know that this buffer is the only one of it's kind, */
 /* and that it's unused (b_count=0), unlocked (b_lock=0), and clean */
 	// 终于找到一个干净的缓冲区，没有被使用，没有被锁住，没有脏数据
+	remove_from_lru(bh);			// 从lru链表中拿走
+	if (bh->b_reada) {				// 预读了却没人用
+		bh->b_reada = 0;
+		ra_misses++;
+	}
 	bh->b_count=1;					// 添加引用计数
 	bh->b_dirt=0;					// 清零脏标记
+	bh->b_flushtime=0;
 	bh->b_uptodate=0;				// 清理更新标记
-	remove_from_queues(bh);			// 从hash表中移除
+	remove_from_hash(bh);			// 从hash表中移除
 	bh->b_dev=dev;					// 设置设备
 	bh->b_blocknr=block;			// 设置逻辑块好
-	insert_into_queues(bh);			// 再使用插入到hash表中
+	insert_into_hash(bh);			// 再使用插入到hash表中
 	return bh;
 }
 
@@ -296,9 +611,65 @@ void brelse(struct buffer_head * buf)
 	if (!buf)
 		return;
 	wait_on_buffer(buf);
-	if (!(buf->b_count--))	// 引用减一，如果引用为0 就说明维护出错了
-		panic("Trying to free free buffer");
+	put_buffer(buf);		// 引用减一，如果引用为0 就放回lru链表
 	wake_up(&buffer_wait);	// 唤醒等待高速缓冲区的进程
+	if (buf->b_dirt && TOO_MANY_DIRTY())
+		wake_up(&bdflush_wait);
+}
+
+/*
+ * Write back the unused dirty buffers that are old enough (or all of
+ * them if too much of the cache is dirty). The dirty list is in release
+ * order, so we can stop at the first young buffer. Each buffer on the
+ * list is looked at at most once, as ll_rw_block() may sleep and
+ * failed writes would otherwise have us loop forever.
+ */
+/// 写回脏lru链表中过期的缓冲块
+static void flush_dirty_buffers(void)
+{
+	struct buffer_head * bh;
+	int nr;
+
+	nr = nr_buffers_type[BUF_DIRTY];
+	while (nr-- > 0 && (bh = lru_list[BUF_DIRTY])) {
+		if (buffer_list(bh) != BUF_DIRTY) {
+			refile_buffer(bh);
+			continue;
+		}
+		if (bh->b_flushtime > jiffies && !TOO_MANY_DIRTY())
+			break;
+		write_cluster(bh);
+		if (!bh->b_count)
+			refile_buffer(bh);
+	}
+}
+
+/*
+ * sys_bdflush() never returns to a well-behaved caller: init forks a
+ * child that calls it, and that child then spends its life in here
+ * writing dirty buffers in the background. Only a signal gets it out.
+ */
+/// 后台回写脏缓冲块的守护进程主体
+int sys_bdflush(void)
+{
+	static int running = 0;
+
+	if (!suser())
+		return -EPERM;
+	if (running)
+		return -EBUSY;
+	running = 1;
+	for (;;) {
+		sync_inodes();
+		flush_dirty_buffers();
+		current->timeout = jiffies + BDF_INTERVAL;
+		interruptible_sleep_on(&bdflush_wait);
+		current->timeout = 0;
+		if (current->signal & ~current->blocked)
+			break;
+	}
+	running = 0;
+	return -EINTR;
 }
 
 /*
@@ -341,18 +712,18 @@ __asm__("cld\n\t" \
  /// 一次性读取四个块的数据到指定地址
  //	b[4]四个指定块号
  //	在其中会使用高速区块，使用完马上释放
+ //	磁盘上连续的块用一个请求项读入
 void bread_page(unsigned long address,int dev,int b[4])
 {
 	struct buffer_head * bh[4];
 	int i;
 
 	for (i=0 ; i<4 ; i++)
-		if (b[i]) {
-			if (bh[i] = getblk(dev,b[i]))
-				if (!bh[i]->b_uptodate)
-					ll_rw_block(READ,bh[i]);
-		} else
+		if (b[i])
+			bh[i] = getblk(dev,b[i]);
+		else
 			bh[i] = NULL;
+	ll_rw_cluster(READ,4,bh);
 	for (i=0 ; i<4 ; i++,address += BLOCK_SIZE)
 		if (bh[i]) {
 			wait_on_buffer(bh[i]);
@@ -362,32 +733,118 @@ void bread_page(unsigned long address,int dev,int b[4])
 		}
 }
 
+/*
+ * bread_cluster() is bread() for the first of 'nr' blocks that are
+ * contiguous on the device: the ones not in the cache are read with as
+ * few requests as possible, and only the first one is waited for.
+ */
+/// 读取从block开始的nr个连续块，返回第一块的缓冲区
+struct buffer_head * bread_cluster(int dev,int block,int nr)
+{
+	struct buffer_head * bh[MAX_CLUSTER];
+	int i;
+
+	if (nr > MAX_CLUSTER)
+		nr = MAX_CLUSTER;
+	if (nr < 1)
+		nr = 1;
+	for (i=0 ; i<nr ; i++)
+		if (!(bh[i]=getblk(dev,block+i)))
+			panic("bread_cluster: getblk returned NULL\n");
+	ll_rw_cluster(READ,nr,bh);
+	for (i=1 ; i<nr ; i++)
+		put_buffer(bh[i]);
+	wake_up(&buffer_wait);	// 放回lru链表的缓冲块可能正有人等着
+	wait_on_buffer(bh[0]);
+	if (bh[0]->b_uptodate)
+		return bh[0];
+	brelse(bh[0]);
+	return NULL;
+}
+
+/*
+ * breada_blocks() starts reading the blocks b[0..nr-1] (zeros are
+ * skipped) and returns at once: nobody waits for them, they just end
+ * up in the cache. Runs of contiguous blocks become one request.
+ * Blocks already in the cache are left alone, so that only buffers we
+ * really read get b_reada, and the hit/miss counts mean something.
+ */
+/// 异步预读b[]中的块，不等待
+void breada_blocks(int dev,int b[],int nr)
+{
+	struct buffer_head * bh[MAX_READAHEAD];
+	int i;
+
+	if (nr > MAX_READAHEAD)
+		nr = MAX_READAHEAD;
+	for (i=0 ; i<nr ; i++)
+		if (b[i] && !find_buffer(dev,b[i]))
+			bh[i] = getblk(dev,b[i]);
+		else
+			bh[i] = NULL;
+	ll_rw_cluster(READA,nr,bh);
+	for (i=0 ; i<nr ; i++)
+		if (bh[i]) {
+			/* it was new: if it's busy now, it's our read */
+			if (!bh[i]->b_mapped && (bh[i]->b_lock || bh[i]->b_uptodate)) {
+				bh[i]->b_reada = 1;
+				ra_issued++;
+			}
+			put_buffer(bh[i]);
+		}
+	wake_up(&buffer_wait);	// 放回lru链表的缓冲块可能正有人等着
+}
+
+/*
+ * bread_ahead() starts reading the 'nr' blocks from 'block' on and
+ * returns at once. Blocks past the end of the device are left alone.
+ */
+/// 异步预读从block开始的nr个连续块
+void bread_ahead(int dev,int block,int nr)
+{
+	int b[MAX_READAHEAD];
+	int i,size;
+
+	if (blk_size[MAJOR(dev)])
+		size = blk_size[MAJOR(dev)][MINOR(dev)];
+	else
+		size = 0x7fffffff;
+	if (block < 0 || block >= size)
+		return;
+	if (nr > size - block)
+		nr = size - block;
+	if (nr > MAX_READAHEAD)
+		nr = MAX_READAHEAD;
+	for (i=0 ; i<nr ; i++)
+		b[i] = block+i;
+	if (nr > 0)
+		breada_blocks(dev,b,nr);
+}
+
 /*
  * Ok, breada can be used as bread, but additionally to mark other
  * blocks for reading as well. End the argument list with a negative
  * number.
  */
  /// heread一样读取块，但同时支持多个块，以负数结尾
- //	返回第一个块号的缓冲区，如果最后还有
+ //	返回第一个块号的缓冲区，后面的块只是异步预读
 struct buffer_head * breada(int dev,int first, ...)
 {
 	va_list args;
-	struct buffer_head * bh, *tmp;
+	struct buffer_head * bh;
+	int b[MAX_READAHEAD];
+	int nr = 0;
 
 	va_start(args,first);
 	if (!(bh=getblk(dev,first)))
 		panic("bread: getblk returned NULL\n");
 	if (!bh->b_uptodate)
 		ll_rw_block(READ,bh);
-	while ((first=va_arg(args,int))>=0) {
-		tmp=getblk(dev,first);
-		if (tmp) {
-			if (!tmp->b_uptodate)
-				ll_rw_block(READA,bh);
-			tmp->b_count--;
-		}
-	}
+	while ((first=va_arg(args,int))>=0)
+		if (nr < MAX_READAHEAD)
+			b[nr++] = first;
 	va_end(args);
+	breada_blocks(dev,b,nr);
 	wait_on_buffer(bh);		// 等解锁
 	if (bh->b_uptodate)		// 如果读出的数据还有效则返回，否则释放缓冲块，返回nul
 		return bh;
@@ -400,7 +857,7 @@ struct buffer_head * breada(int dev,int first, ...)
 //	
 void buffer_init(long buffer_end)
 {
-	struct buffer_head * h = start_buffer;
+	struct buffer_head * h;
 	void * b;
 	int i;
 
@@ -408,12 +865,33 @@ void buffer_init(long buffer_end)
 		b = (void *) (640*1024);
 	else
 		b = (void *) buffer_end;
+/*
+ * Size the hash table from the number of buffers we are about to make:
+ * a power of two with at most two buffers per chain on average. It is
+ * taken from the start of the buffer area, before the buffer heads.
+ */
+	i = (long) b - (long) start_buffer;
+	if (b > (void *) 0x100000)
+		i -= 0x100000 - 0xA0000;
+	i /= BLOCK_SIZE + sizeof(struct buffer_head);
+	for (nr_hash = 16, hash_shift = 28 ; nr_hash*2 < i ; nr_hash <<= 1)
+		hash_shift--;
+	hash_table = (struct buffer_head **) start_buffer;
+	start_buffer = (struct buffer_head *) (hash_table + nr_hash);
+	h = start_buffer;
 	// 初始化每个缓冲块头
 	while ( (b -= BLOCK_SIZE) >= ((void *) (h+1)) ) {
 		h->b_dev = 0;
 		h->b_dirt = 0;
 		h->b_count = 0;
 		h->b_lock = 0;
+		h->b_list = BUF_CLEAN;
+		h->b_flushtime = 0;
+		h->b_reada = 0;
+		h->b_mapped = 0;
+		h->b_reqnext = NULL;
+		h->b_end_io = NULL;
+		h->b_private = NULL;
 		h->b_uptodate = 0;
 		h->b_wait = NULL;
 		h->b_next = NULL;
@@ -427,10 +905,50 @@ void buffer_init(long buffer_end)
 			b = (void *) 0xA0000;
 	}
 	h--;// 回调到最后一个缓冲块头
-	free_list = start_buffer;
-	free_list->b_prev_free = h;
-	h->b_next_free = free_list;		// 完成双向链表闭环
+	lru_list[BUF_CLEAN] = start_buffer;
+	start_buffer->b_prev_free = h;
+	h->b_next_free = start_buffer;	// 完成双向链表闭环
+	lru_list[BUF_DIRTY] = lru_list[BUF_LOCKED] = NULL;
+	nr_buffers_type[BUF_CLEAN] = NR_BUFFERS;
 	// 整理hash表
-	for (i=0;i<NR_HASH;i++)
+	for (i=0;i<nr_hash;i++)
 		hash_table[i]=NULL;
+}
+
+/*
+ * Debugging aid, called from show_mem() (shift-scroll-lock): lru-list
+ * sizes and how long the hash chains are. The average nr of probes per
+ * lookup should stay close to 1.
+ */
+/// 打印缓冲区lru链表和hash链长度的统计信息
+void show_buffers(void)
+{
+	int i,len,max = 0,used = 0;
+	int hist[5] = {0, };
+	struct buffer_head * bh;
+
+	printk("Buffer-info:\n\r");
+	printk("%d buffers: %d clean, %d dirty, %d locked, %d in use\n\r",
+		NR_BUFFERS,nr_buffers_type[BUF_CLEAN],
+		nr_buffers_type[BUF_DIRTY],nr_buffers_type[BUF_LOCKED],
+		NR_BUFFERS-nr_buffers_type[BUF_CLEAN]-
+		nr_buffers_type[BUF_DIRTY]-nr_buffers_type[BUF_LOCKED]);
+	for (i=0 ; i<nr_hash ; i++) {
+		for (len=0,bh=hash_table[i] ; bh ; bh=bh->b_next)
+			len++;
+		if (len)
+			used++;
+		if (len > max)
+			max = len;
+		hist[len<4?len:4]++;
+	}
+	printk("%d hash chains, %d used, longest %d\n\r",nr_hash,used,max);
+	printk("chain length 0:%d 1:%d 2:%d 3:%d 4+:%d\n\r",
+		hist[0],hist[1],hist[2],hist[3],hist[4]);
+	if (hash_lookups)
+		printk("%d lookups, %d.%02d probes/lookup\n\r",hash_lookups,
+			hash_probes/hash_lookups,
+			(hash_probes%hash_lookups)*100/hash_lookups);
+	printk("read-ahead: %d blocks issued, %d used, %d evicted unused\n\r",
+		ra_issued,ra_hits,ra_misses);
 }	
@@ -14,19 +14,87 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
+/*
+ * Read file block 'block' (which is at 'nr' on the device). If it isn't
+ * in the cache, the following blocks of the file that are contiguous
+ * on disk are read along with it, up to 'max' blocks.
+ */
+static struct buffer_head * file_bread(struct m_inode * inode,
+	int block, int nr, int max)
+{
+	struct buffer_head * bh;
+	int n;
+
+	if ((bh = get_hash_table(inode->i_dev,nr)) && bh->b_uptodate)
+		return bh;
+	brelse(bh);
+	if (max > MAX_CLUSTER)
+		max = MAX_CLUSTER;
+	for (n=1 ; n<max ; n++)
+		if (bmap(inode,block+n) != nr+n)
+			break;
+	return bread_cluster(inode->i_dev,nr,n);
+}
+
+/*
+ * Sequential read-ahead. A read that starts where the last one ended
+ * grows the window (MIN_READAHEAD, then doubling up to MAX_READAHEAD),
+ * anything else collapses it. Blocks up to the window past the end of
+ * this read are started asynchronously, unless already read ahead.
+ */
+static void file_readahead(struct m_inode * inode, struct file * filp,
+	int count)
+{
+	int b[MAX_READAHEAD];
+	unsigned long start,end,size;
+	int i;
+
+	if (filp->f_pos != filp->f_rapos) {
+		filp->f_rawin = 0;
+		filp->f_raend = 0;
+		return;
+	}
+	if (!filp->f_rawin)
+		filp->f_rawin = MIN_READAHEAD;
+	else if ((filp->f_rawin <<= 1) > MAX_READAHEAD)
+		filp->f_rawin = MAX_READAHEAD;
+	start = (filp->f_pos + count + BLOCK_SIZE-1) / BLOCK_SIZE;
+	end = start + filp->f_rawin;
+	size = (inode->i_size + BLOCK_SIZE-1) / BLOCK_SIZE;
+	if (end > size)
+		end = size;
+	if (start < filp->f_raend)
+		start = filp->f_raend;
+	if (start >= end)
+		return;
+	filp->f_raend = end;
+	for (i=0 ; start<end ; i++,start++)
+		b[i] = bmap(inode,start);
+	breada_blocks(inode->i_dev,b,i);
+}
+
 int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
-	int left,chars,nr;
+	int left,chars,nr,block;
+	int ahead = 1;
 	struct buffer_head * bh;
 
 	if ((left=count)<=0)
 		return 0;
 	while (left) {
-		if (nr = bmap(inode,(filp->f_pos)/BLOCK_SIZE)) {
-			if (!(bh=bread(inode->i_dev,nr)))
+		block = (filp->f_pos)/BLOCK_SIZE;
+		if (nr = bmap(inode,block)) {
+			chars = (filp->f_pos % BLOCK_SIZE) + left;
+			if (!(bh=file_bread(inode,block,nr,
+			    (chars+BLOCK_SIZE-1)/BLOCK_SIZE)))
 				break;
 		} else
 			bh = NULL;
+		/* start read-ahead once the first block is on its way */
+		if (ahead) {
+			file_readahead(inode,filp,left);
+			ahead = 0;
+		}
 		nr = filp->f_pos % BLOCK_SIZE;
 		chars = MIN( BLOCK_SIZE-nr , left );
 		filp->f_pos += chars;
@@ -41,6 +109,7 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 				put_fs_byte(0,buf++);
 		}
 	}
+	filp->f_rapos = filp->f_pos;
 	inode->i_atime = CURRENT_TIME;
 	return (count-left)?(count-left):-ERROR;
 }
@@ -12,6 +12,9 @@
 
 extern int tty_ioctl(int dev, int cmd, int arg);
 extern int pipe_ioctl(struct m_inode *pino, int cmd, int arg);
+extern int blk_ioctl(int dev, int cmd, int arg);
+extern int fd_ioctl(int dev, int cmd, int arg);
+extern int md_ioctl(int dev, int cmd, int arg);
 
 typedef int (*ioctl_ptr)(int dev,int cmd,int arg);
 
@@ -20,12 +23,14 @@ typedef int (*ioctl_ptr)(int dev,int cmd,int arg);
 static ioctl_ptr ioctl_table[]={
 	NULL,		/* nodev */
 	NULL,		/* /dev/mem */
-	NULL,		/* /dev/fd */
-	NULL,		/* /dev/hd */
+	fd_ioctl,	/* /dev/fd */
+	blk_ioctl,	/* /dev/hd */
 	tty_ioctl,	/* /dev/ttyx */
 	tty_ioctl,	/* /dev/tty */
 	NULL,		/* /dev/lp */
-	NULL};		/* named pipes */
+	NULL,		/* named pipes */
+	NULL,
+	md_ioctl};	/* /dev/md */
 	
 
 int sys_ioctl(unsigned int fd, unsigned int cmd, unsigned long arg)
@@ -24,3 +24,14 @@ __asm__ volatile ("inb %%dx,%%al\n" \
 	"1:":"=a" (_v):"d" (port)); \
 _v; \
 })
+
+// 向端口中写数据 4字节
+#define outl(value,port) \
+__asm__ ("outl %%eax,%%dx"::"a" (value),"d" (port))
+
+// 从端口中读数据 4字节
+#define inl(port) ({ \
+unsigned long _v; \
+__asm__ volatile ("inl %%dx,%%eax":"=a" (_v):"d" (port)); \
+_v; \
+})
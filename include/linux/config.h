@@ -25,6 +25,30 @@
  * The keyboard is now defined in kernel/chr_dev/keyboard.S
  */
 
+/*
+ * The I/O scheduler block devices start out with (see IOSCHED_xxx in
+ * <linux/fs.h>): 0 - noop, 1 - C-SCAN elevator, 2 - deadline. It can be
+ * changed per device later on with the BLKSETSCHED ioctl.
+ */
+#define DEF_IOSCHED 1
+
+/*
+ * Define HD_DMA to have the harddisk driver look for a PCI IDE
+ * controller that can do bus-master DMA (like the PIIX ones), and use
+ * it for the drives that say they can. Without one it falls back to
+ * programmed I/O, as always.
+ */
+/* #define HD_DMA */
+
+/*
+ * The BIOS only tells us about two drives, not where they sit. Normally
+ * the second one is the slave on the primary IDE channel, and the two
+ * take turns. Define HD_SECOND_CHANNEL if it is the master of the
+ * secondary channel (ports 0x170, irq 15): both drives then work at the
+ * same time.
+ */
+/* #define HD_SECOND_CHANNEL */
+
 /*
  * Normally, Linux can get the drive parameters from the BIOS at
  * startup, but if this for some unfathomable reason fails, you'd
@@ -27,6 +27,7 @@
 #define WRITE 1
 #define READA 2		/* read-ahead - don't pause */
 #define WRITEA 3	/* "write-ahead" - silly, but somewhat useful */
+#define FLUSH 4		/* flush the drive's write cache: a barrier request */
 
 void buffer_init(long buffer_end);
 
@@ -44,7 +45,6 @@ void buffer_init(long buffer_end);
 #define NR_INODE 64
 #define NR_FILE 64
 #define NR_SUPER 8
-#define NR_HASH 307
 #define NR_BUFFERS nr_buffers
 #define BLOCK_SIZE 1024
 #define BLOCK_SIZE_BITS 10
@@ -79,11 +79,87 @@ struct buffer_head {
 	unsigned char b_dirt;		/* 0-clean,1-dirty */					// 修改标记，0#没有|1#有修改,需要写入磁盘
 	unsigned char b_count;		/* users using this block */			// 使用该块的进程数量 根据它判断是否释放
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */					// 是否被锁定 =0#未锁|1#锁住
+	unsigned char b_list;		/* BUF_CLEAN/DIRTY/LOCKED when unused */	// 空闲时所在的lru链表
+	unsigned char b_reada;		/* read ahead, not used yet */			// 预读进来还未被使用
+	unsigned char b_mapped;		/* b_data is the ram disk itself */		// 数据就在虚拟盘上 不在缓冲区中
+	unsigned long b_flushtime;	/* jiffies when dirty buffer is too old */	// 脏块应被写回的时刻
 	struct task_struct * b_wait;										// 等待此缓冲区的任务
 	struct buffer_head * b_prev;										// hash队列上前一块
 	struct buffer_head * b_next;										// hash队列上后一块
-	struct buffer_head * b_prev_free;									// 空前列表前一块
-	struct buffer_head * b_next_free;									// 空闲列表后一块
+	struct buffer_head * b_prev_free;									// lru链表前一块
+	struct buffer_head * b_next_free;									// lru链表后一块 NULL表示不在链表中
+	struct buffer_head * b_reqnext;		/* next buffer of the same request */	// 同一请求项中的下一块
+	void (*b_end_io)(struct buffer_head * bh, int uptodate);	/* called when I/O is done, instead of unlocking */
+	void * b_private;		/* for b_end_io */						// md影子缓冲块: 对应的真正缓冲块
+};
+
+/*
+ * Unused buffers (b_count == 0) live on one of these lru-lists,
+ * so that getblk() never has to look at more than a list head.
+ */
+#define BUF_CLEAN	0
+#define BUF_DIRTY	1
+#define BUF_LOCKED	2
+#define NR_LIST		3
+
+/*
+ * Max nr of contiguous blocks read or written with one request.
+ */
+#define MAX_CLUSTER	8
+
+/*
+ * Per-file read-ahead window, in blocks: it starts at MIN_READAHEAD on
+ * the second sequential read and doubles up to MAX_READAHEAD.
+ */
+#define MIN_READAHEAD	2
+#define MAX_READAHEAD	16
+
+/*
+ * Block device ioctls: pick the I/O scheduler of a device, and see how
+ * long its requests have been waiting.
+ */
+#define BLKGETSCHED	0x1201
+#define BLKSETSCHED	0x1202
+#define BLKGETWAIT	0x1203	/* longest read/write queue wait, in ticks */
+
+#define IOSCHED_NOOP		0	/* first come, first served */
+#define IOSCHED_CSCAN		1	/* one-way elevator */
+#define IOSCHED_DEADLINE	2	/* elevator + read/write deadlines */
+#define NR_IOSCHED		3
+
+/*
+ * The FDGETSTAT ioctl on a floppy copies the struct fd_stat of the
+ * controller to arg and starts counting anew: how often, and for how
+ * many ticks in all, requests waited for each phase.
+ */
+#define FDGETSTAT	0x0201	/* arg: struct fd_stat */
+
+struct fd_stat {
+	unsigned long motor, motor_ticks;	/* motor spin-ups */
+	unsigned long seek, seek_ticks;		/* seeks, not counting implied ones */
+	unsigned long rw, rw_ticks;		/* read/write commands */
+	unsigned long cache_hits;		/* blocks read from the cylinder cache */
+	unsigned long batched;			/* requests done early, on the same cylinder */
+};
+
+/*
+ * md devices: RAID-0/RAID-1 sets of other block devices, set up with
+ * the MDSETUP ioctl on the md device.
+ */
+#define MD_MAJOR	9
+#define MD_MAX_DISKS	4
+
+#define MDSETUP		0x0901	/* arg: struct md_setup */
+#define MDSTOP		0x0902
+
+#define MD_RAID0	0	/* striped */
+#define MD_RAID1	1	/* mirrored */
+
+struct md_setup {
+	int level;			/* MD_RAID0 or MD_RAID1 */
+	int chunk;			/* RAID-0: blocks per disk in turn */
+	int nr_disks;
+	int disks[MD_MAX_DISKS];	/* device numbers */
 };
 
 /// 设备中的inode节点信息  占用32字节
@@ -129,6 +205,9 @@ struct file {
 	unsigned short f_count;
 	struct m_inode * f_inode;
 	off_t f_pos;
+	off_t f_rapos;					/* f_pos after the last read */		// 上次读结束的位置
+	unsigned long f_raend;			/* first block not read ahead yet */	// 预读到的块号(不含)
+	unsigned short f_rawin;			/* read-ahead window in blocks */		// 预读窗口大小
 };
 /*
   磁盘
@@ -225,16 +304,24 @@ extern struct buffer_head * getblk(int dev, int block);
 //	或者从设备读取bh设定指定块数据到缓冲区
 extern void ll_rw_block(int rw, struct buffer_head * bh);
 extern void ll_rw_page(int rw, int dev, int nr, char * buffer);
+extern void ll_rw_cluster(int rw, int nr, struct buffer_head * bh[]);
+extern int ll_rw_flush(int dev);
 extern void brelse(struct buffer_head * buf);
 // 读取设备号dev的 指定块的数据(block 从0开始)
 extern struct buffer_head * bread(int dev,int block);
 extern void bread_page(unsigned long addr,int dev,int b[4]);
 extern struct buffer_head * breada(int dev,int block,...);
+extern struct buffer_head * bread_cluster(int dev,int block,int nr);
+extern void breada_blocks(int dev,int b[],int nr);
+extern void bread_ahead(int dev,int block,int nr);
 extern int new_block(int dev);
 extern int free_block(int dev, int block);
 extern struct m_inode * new_inode(int dev);
 extern void free_inode(struct m_inode * inode);
 extern int sync_dev(int dev);
+extern int fsync_dev(int dev);
+extern void invalidate_buffers(int dev);
+extern void show_buffers(void);
 
 /// 获取指定设备号得超级块
 extern struct super_block * get_super(int dev);
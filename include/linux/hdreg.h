@@ -40,6 +40,47 @@
 #define WIN_SEEK 		0x70
 #define WIN_DIAGNOSE		0x90
 #define WIN_SPECIFY		0x91
+#define WIN_MULTREAD		0xC4	/* read sectors, one interrupt per block */
+#define WIN_MULTWRITE		0xC5	/* write sectors, one interrupt per block */
+#define WIN_SETMULT		0xC6	/* set sectors per block for the above */
+#define WIN_READDMA		0xC8	/* read sectors using bus-master DMA */
+#define WIN_WRITEDMA		0xCA	/* write sectors using bus-master DMA */
+#define WIN_READ_EXT		0x24	/* LBA48 versions of the above */
+#define WIN_READDMA_EXT		0x25
+#define WIN_MULTREAD_EXT	0x29
+#define WIN_WRITE_EXT		0x34
+#define WIN_WRITEDMA_EXT	0x35
+#define WIN_MULTWRITE_EXT	0x39
+#define WIN_FLUSH		0xE7	/* write the drive's cache to the medium */
+#define WIN_FLUSH_EXT		0xEA
+#define WIN_IDENTIFY		0xEC	/* ask the drive to identify itself */
+
+/* Words of the WIN_IDENTIFY data */
+#define ID_MAX_MULTSECT		47	/* low byte: max sectors per block */
+#define ID_CAPABILITY		49	/* 0x100: DMA, 0x200: LBA supported */
+#define ID_LBA_SECTORS		60	/* 2 words: nr of LBA28 sectors */
+#define ID_COMMAND_SET2		83	/* 0x400: LBA48 supported */
+#define ID_LBA48_SECTORS	100	/* 4 words: nr of LBA48 sectors */
+
+#define LBA28_MAX	0x0fffffff	/* sectors beyond this need LBA48 */
+
+/* Bus-master IDE regs, from the I/O base in PCI BAR4 (primary channel) */
+#define BM_COMMAND	0
+#define BM_STATUS	2
+#define BM_PRDT		4	/* physical address of the PRD table */
+
+#define BM_START	0x01	/* BM_COMMAND: start transfer */
+#define BM_READ		0x08	/* BM_COMMAND: transfer to memory */
+#define BM_ACTIVE	0x01	/* BM_STATUS bits */
+#define BM_ERROR	0x02
+#define BM_INTR		0x04
+
+/* One entry of the PRD table: a physical region of memory */
+struct prd {
+	unsigned long addr;
+	unsigned long count;	/* bytes in the low 16 bits (0 = 64kB) */
+};
+#define PRD_EOT		0x80000000	/* last entry of the table */
 
 /* Bits for HD_ERROR */
 #define MARK_ERR	0x01	/* Bad address mark ? */
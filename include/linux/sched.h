@@ -110,6 +110,22 @@ TASK_ZOMBIE				3	僵死
 TASK_STOPPED			4	暂停
 */
 
+/*
+ * A timer of the timer wheel (kernel/sched.c): once it is started,
+ * fn(data) is called from the timer interrupt when 'expires' has come.
+ * A pending timer is on a list of the wheel through next/prev, next is
+ * NULL when it isn't.
+ */
+struct timer_list {
+	struct timer_list * next, * prev;	/* first: the wheel's list heads */
+	unsigned long expires;
+	void (*fn)(unsigned long);
+	unsigned long data;
+};
+
+extern void start_timer(struct timer_list * timer, unsigned long ticks);
+extern int stop_timer(struct timer_list * timer);
+
 // 进程的数据结构
 struct task_struct {
 /* these are hardcoded - don't touch */
@@ -156,6 +172,13 @@ struct task_struct {
 	struct rlimit rlim[RLIM_NLIMITS]; 		// 进程资源使用统计数组
 	unsigned int flags;						// 进程的标志，还未使用？ 
 	unsigned short used_math;				// 标记是否使用了协处理器
+/* run queue */
+	int nr;									// 在task[]中的下标
+	struct task_struct * next_run;			// 就绪队列链表 不在队列中时为NULL
+	struct task_struct * prev_run;
+	unsigned long run_epoch;				// counter已按第几次重算更新过
+	struct timer_list timeout_timer;		// timeout的定时器 任务睡眠时才启动
+	struct timer_list alarm_timer;			// alarm的定时器
 /* file system info */
 	int tty;								// 进程使用的tty终端的子设备号 -1 表示没有使用 
 	unsigned short umask;					// 文件创建属性屏蔽位
@@ -195,6 +218,8 @@ struct task_struct {
 		  {0x7fffffff, 0x7fffffff}, {0x7fffffff, 0x7fffffff}}, \
 /* flags */	0, \
 /* math */	0, \
+/* run queue */	0,NULL,NULL,0, \
+/* timers */	{NULL,},{NULL,}, \
 /* fs info */	-1,0022,NULL,NULL,NULL,NULL,0, \
 /* filp */	{NULL,}, \
 	{ \
@@ -219,10 +244,13 @@ extern int jiffies_offset;
 
 #define CURRENT_TIME (startup_time+(jiffies+jiffies_offset)/HZ)
 
-extern void add_timer(long jiffies, void (*fn)(void));
+extern int add_timer(long jiffies, void (*fn)(void));
+extern int del_timer(int handle);
 extern void sleep_on(struct task_struct ** p);
 extern void interruptible_sleep_on(struct task_struct ** p);
 extern void wake_up(struct task_struct ** p);
+extern void wake_up_process(struct task_struct * p);
+extern void signal_wake_up(struct task_struct * p);
 extern int in_group_p(gid_t grp);
 
 /*
@@ -146,6 +146,8 @@
 #define __NR_lstat	84
 #define __NR_readlink	85
 #define __NR_uselib	86
+#define __NR_bdflush	87
+#define __NR_fsync	88
 
 #define _syscall0(type,name) \
 type name(void) \
@@ -250,6 +252,8 @@ int stat(const char * filename, struct stat * stat_buf);
 int fstat(int fildes, struct stat * stat_buf);
 int stime(time_t * tptr);
 int sync(void);
+int bdflush(void);
+int fsync(int fildes);
 time_t time(time_t * tloc);
 time_t times(struct tms * tbuf);
 int ulimit(int cmd, long limit);
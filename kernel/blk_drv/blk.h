@@ -11,27 +11,43 @@
 	4	字符	ttyx（虚拟/串行终端）	null
 	5	字符	tty设备	null
 	6	字符	lp打印机	null
+	9	块	md,RAID-0/1	md_remap()
 */
-#define NR_BLK_DEV	7
+#define NR_BLK_DEV	10
 
 /*
- * NR_REQUEST is the number of entries in the request-queue.
- * NOTE that writes may use only the low 2/3 of these: reads
- * take precedence.
+ * NR_REQUEST is the default depth of the request-queue of a device.
+ * NOTE that writes may use only 2/3 of these: reads take precedence
+ * (unless the device uses the noop scheduler).
  *
  * 32 seems to be a reasonable number: enough to get some benefit
  * from the elevator-mechanism, but not so much as to lock a lot of
  * buffers when they are in the queue. 64 seems to be too many (easily
  * long pauses in reading when heavy writing/syncing is going on)
+ *
+ * The requests themselves come from a pool shared by all devices, which
+ * grows a page at a time up to MAX_REQUEST_PAGES.
  */
- // 请求项队列数量
+ // 每个设备请求项队列的默认深度
 #define NR_REQUEST	32
+#define MAX_REQUEST_PAGES	2
+
+/*
+ * Requests for adjacent sectors are merged, up to MAX_SECTORS in all
+ * (the hd sector count register is 8 bits wide).
+ */
+#define MAX_SECTORS	64
 
 /*
  * Ok, this is an expanded form so that we can use the same
  * request for paging requests when that is implemented. In
  * paging, 'bh' is NULL, and 'waiting' is used to wait for
  * read/write completion.
+ *
+ * A request may cover several contiguous blocks: 'bh' is then the
+ * first of a list linked through b_reqnext and ending in 'bhtail'.
+ * 'sector', 'nr_sectors' and 'buffer' always describe what is left,
+ * starting with the data of 'bh'.
  */
 struct request {
 	int dev;		/* -1 if no request */	// 发请求的设备号
@@ -41,7 +57,13 @@ struct request {
 	unsigned long nr_sectors;				// 本次请求 读写扇区数
 	char * buffer;							// 数据缓冲区
 	struct task_struct * waiting;			// 任务等待请求完成操作的地方
+	int * status;							// 不为NULL时 结束时在这里放uptodate
 	struct buffer_head * bh;				// 缓冲区头指针  定义include/linux/fs.h
+	struct buffer_head * bhtail;			// 缓冲块链表的最后一块
+	unsigned long start;					// 进入队列时的jiffies
+	unsigned long expires;					// 截止时间 超时后不再按电梯顺序等待
+	struct request * fifo_next;				// deadline调度器的读/写FIFO
+	struct request * fifo_prev;
 	struct request * next;					// 下一个请求
 };
 
@@ -67,14 +89,51 @@ struct request {
 struct blk_dev_struct {
 	void (*request_fn)(void);				// 请求处理函数指针
 	struct request * current_request;		// 请求结构
+	struct iosched * sched;					// 该设备使用的I/O调度器
+	struct request * fifo[2];				// deadline: 最早的读/写请求
+	unsigned long max_wait[2];				// 读/写请求的最长排队时间(滴答)
+	int nr_requests;						// 该设备占用的请求项数
+	int max_requests;						// 该设备最多可占用的请求项数
+	struct blk_dev_struct * (*queue)(int dev);	// 驱动有多个请求队列时 取dev的队列
+	int (*remap)(int rw, int dev, struct buffer_head * first,
+		struct buffer_head * last, int nr);	// 不排队 把缓冲块转交给其它设备(md) FLUSH时返回结果
+};
+
+/*
+ * How long a request may wait in the queue before the scheduler does
+ * it out of elevator order: reads are waited on by somebody, writes
+ * usually aren't.
+ */
+#define READ_EXPIRE	(HZ/2)		// 读请求最多等待0.5秒
+#define WRITE_EXPIRE	(5*HZ)		// 写请求最多等待5秒
+
+/*
+ * An I/O scheduler decides where a new request goes in the queue of a
+ * device (add_request, called with interrupts off and the queue not
+ * empty), and which request the driver gets once the one at the head
+ * is done (next_request, called from end_request()). write_pct is the
+ * percentage of the depth of the queue that writes may take, the rest
+ * being kept for reads.
+ * The ids are the IOSCHED_xxx values of <linux/fs.h>.
+ */
+// I/O调度器操作表
+struct iosched {
+	char * name;
+	int write_pct;
+	void (*add_request)(struct blk_dev_struct * dev, struct request * req);
+	struct request * (*next_request)(struct blk_dev_struct * dev);
 };
 
+extern struct iosched iosched[NR_IOSCHED];
+extern void set_iosched(struct blk_dev_struct * dev, int nr);
+extern struct request * next_request(struct blk_dev_struct * dev);
+extern void promote_request(struct blk_dev_struct * dev, struct request * req);
+extern void free_request(struct request * req);
+extern void submit_buffers(int rw, int rw_ahead,
+	struct buffer_head * first, struct buffer_head * last, int nr);
+
 // 块设备表	每种块设备占用一项，索引值为主设备号
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
-// 请求项数组 
-extern struct request request[NR_REQUEST];
-// 等待空闲请求项的进程队列头指针
-extern struct task_struct * wait_for_request;
 
 // 一个块设备上数据块的总数指针数组
 // 每个指针指向指定主设备号的总块数数组 hd_sizes[] blk_drv/hd.c
@@ -112,8 +171,7 @@ extern int * blk_size[NR_BLK_DEV];
 /* harddisk */
 //	硬盘
 #define DEVICE_NAME "harddisk"						// 设备名称（硬盘）
-#define DEVICE_INTR do_hd							// 设备中断处理函数
-#define DEVICE_TIMEOUT hd_timeout					// 设备超时值
+#define DEVICE_QUEUE (hd_chan->queue)				// 当前通道正在处理的请求队列
 #define DEVICE_REQUEST do_hd_request				// 设备请求项处理函数
 #define DEVICE_NR(device) (MINOR(device)/5)			// 硬盘设备号(0-1)
 #define DEVICE_ON(device)							// 一开机硬盘就是运转着
@@ -125,8 +183,16 @@ extern int * blk_size[NR_BLK_DEV];
 
 #endif
 
+/*
+ * A driver with more than one request queue (one per drive, say) defines
+ * DEVICE_QUEUE as the queue it is working on, and CURRENT is the head of
+ * that one.
+ */
+#ifndef DEVICE_QUEUE
+#define DEVICE_QUEUE (blk_dev+MAJOR_NR)
+#endif
 // 是指定设备号的当前请求结构的的指针
-#define CURRENT (blk_dev[MAJOR_NR].current_request)
+#define CURRENT (DEVICE_QUEUE->current_request)
 // 当前请求项设备的设备号 硬盘为0/1
 #define CURRENT_DEV DEVICE_NR(CURRENT->dev)
 
@@ -140,7 +206,7 @@ void (*DEVICE_INTR)(void) = NULL;
 int DEVICE_TIMEOUT = 0;
 // 设置中断函数，并同时设置超时
 #define SET_INTR(x) (DEVICE_INTR = (x),DEVICE_TIMEOUT = 200)
-#else
+#elif defined(DEVICE_INTR)
 #define SET_INTR(x) (DEVICE_INTR = (x))
 #endif
 // 声明请求函数
@@ -155,26 +221,52 @@ extern inline void unlock_buffer(struct buffer_head * bh)
 	wake_up(&bh->b_wait);
 }
 
+/*
+ * end_request() finishes the first buffer of CURRENT. If the request
+ * has more buffers it is set up to continue with the next one, and
+ * CURRENT stays the same: drivers just keep going until CURRENT changes.
+ */
 // 结束请求处理宏
 // uptodate # 更新标记，应该时间相关数据 | =0#表示更新失败
 extern inline void end_request(int uptodate)
 {
+	struct buffer_head * bh;
+	struct request * req;
+
 	DEVICE_OFF(CURRENT->dev);		// 关闭设备
-	if (CURRENT->bh) {
-		// 更新缓冲头，并解锁
-		CURRENT->bh->b_uptodate = uptodate;
-		unlock_buffer(CURRENT->bh);
-	}
 	// 更新标失败
 	if (!uptodate) {
 		printk(DEVICE_NAME " I/O error\n\r");
-		printk("dev %04x, block %d\n\r",CURRENT->dev,
-			CURRENT->bh->b_blocknr);
+		printk("dev %04x, sector %d\n\r",CURRENT->dev,
+			CURRENT->sector);
+	}
+	if (bh = CURRENT->bh) {
+		// 更新缓冲头，并解锁
+		CURRENT->bh = bh->b_reqnext;
+		bh->b_reqnext = NULL;
+		if (bh->b_end_io)
+			(bh->b_end_io)(bh,uptodate);
+		else {
+			bh->b_uptodate = uptodate;
+			unlock_buffer(bh);
+		}
+		// 还有后续缓冲块，继续处理同一请求项
+		if (bh = CURRENT->bh) {
+			CURRENT->errors = 0;
+			CURRENT->sector = bh->b_blocknr<<1;
+			CURRENT->nr_sectors =
+				(CURRENT->bhtail->b_blocknr - bh->b_blocknr + 1)<<1;
+			CURRENT->buffer = bh->b_data;
+			return;
+		}
 	}
+	if (CURRENT->status)			// 等待的进程要知道结果
+		*CURRENT->status = uptodate;
 	wake_up(&CURRENT->waiting);		// 唤醒等待该请求的进程    让那些进程不要等待了
-	wake_up(&wait_for_request);		// 唤醒等待空闲请求项的进程
-	CURRENT->dev = -1;				// 释放该请求项
-	CURRENT = CURRENT->next;		// 指向下一个请求项
+	req = CURRENT;
+	// 由I/O调度器选出下一个请求项
+	CURRENT = next_request(DEVICE_QUEUE);
+	free_request(req);				// 释放该请求项 唤醒等待空闲请求项的进程
 }
 
 #ifdef DEVICE_TIMEOUT
@@ -44,8 +44,25 @@
 static int recalibrate = 0;
 static int reset = 0;
 static int seek = 0;
+static int implied_seek = 0;	// 控制器会在读写命令中自己寻道(82077)
+
+/*
+ * When the motor has to spin up before a request, and it needs a seek,
+ * the seek is started at once. 'overlap' then says how far it got:
+ * 1 - seeking, motor not up yet
+ * 2 - motor up, seek_interrupt() goes on with the request
+ * 3 - seek done, motor_on_interrupt() goes on with the request
+ */
+static int overlap = 0;
+static struct timer_list motor_timer;	// motor_on_interrupt()的定时器
+static struct timer_list fd_timer;		// fd_delay()的定时器
+static void (*fd_resume)(void);			// fd_timer到时调用的函数
+
+static struct fd_stat fd_stat;	// 各阶段的次数和滴答数
+static unsigned long seek_start, rw_start;
 
 extern unsigned char current_DOR;
+extern int blk_ioctl(int dev, int cmd, int arg);
 
 #define immoutb_p(val,port) \
 __asm__("outb %0,%1\n\tjmp 1f\n1:\tjmp 1f\n1:"::"a" ((char) (val)),"i" (port))
@@ -59,6 +76,13 @@ __asm__("outb %0,%1\n\tjmp 1f\n1:\tjmp 1f\n1:"::"a" ((char) (val)),"i" (port))
  */
 #define MAX_ERRORS 8
 
+/*
+ * Reads are done a cylinder at a time, into tmp_floppy_area, and the
+ * blocks are copied out of it from then on until something else is read
+ * or written there. TRACK_AREA is the size of the largest cylinder.
+ */
+#define TRACK_AREA (2*18*512)
+
 /*
  * globals used by 'result()'
  */
@@ -103,7 +127,7 @@ static struct floppy_struct {
  */
 
 extern void floppy_interrupt(void);
-extern char tmp_floppy_area[1024];
+extern char tmp_floppy_area[TRACK_AREA];
 
 /*
  * These are global variables, as that's the easiest way to give
@@ -120,6 +144,10 @@ static unsigned char track = 0;
 static unsigned char seek_track = 0;
 static unsigned char current_track = 255;
 static unsigned char command = 0;
+static int cache_fill = 0;		// 正在把整个柱面读入缓存
+static int cache_drive = -1;		// 缓存的驱动器 -1表示缓存无效
+static int cache_track = 0;		// 缓存的柱面
+static struct floppy_struct * cache_type = NULL;	// 缓存时的软盘类型
 unsigned char selected = 0;
 struct task_struct * wait_on_floppy_select = NULL;
 
@@ -147,6 +175,8 @@ repeat:
 		goto repeat;
 	if (inb(FD_DIR) & 0x80) {
 		floppy_off(nr);
+		if (cache_drive == nr)
+			cache_drive = -1;
 		return 1;
 	}
 	floppy_off(nr);
@@ -158,15 +188,17 @@ __asm__("cld ; rep ; movsl" \
 	::"c" (BLOCK_SIZE/4),"S" ((long)(from)),"D" ((long)(to)) \
 	:"cx","di","si")
 
-static void setup_DMA(void)
+/// 设置DMA通道2 传输count字节 buf在1MB以上时经tmp_floppy_area中转
+static void setup_DMA(char * buf, int count)
 {
-	long addr = (long) CURRENT->buffer;
+	long addr = (long) buf;
 
 	cli();
 	if (addr >= 0x100000) {
 		addr = (long) tmp_floppy_area;
+		cache_drive = -1;	/* the cached cylinder is gone */
 		if (command == FD_WRITE)
-			copy_buffer(CURRENT->buffer,tmp_floppy_area);
+			copy_buffer(buf,tmp_floppy_area);
 	}
 /* mask DMA 2 */
 	immoutb_p(4|2,10);
@@ -183,10 +215,11 @@ static void setup_DMA(void)
 	addr >>= 8;
 /* bits 16-19 of addr */
 	immoutb_p(addr,0x81);
-/* low 8 bits of count-1 (1024-1=0x3ff) */
-	immoutb_p(0xff,5);
+	count--;
+/* low 8 bits of count-1 */
+	immoutb_p(count,5);
 /* high 8 bits of count-1 */
-	immoutb_p(3,5);
+	immoutb_p(count >> 8,5);
 /* activate DMA 2 */
 	immoutb_p(0|2,10);
 	sti();
@@ -250,6 +283,8 @@ static void bad_flp_intr(void)
  */
 static void rw_interrupt(void)
 {
+	fd_stat.rw++;
+	fd_stat.rw_ticks += jiffies - rw_start;
 	if (result() != 7 || (ST0 & 0xf8) || (ST1 & 0xbf) || (ST2 & 0x73)) {
 		if (ST1 & 0x02) {
 			printk("Drive %d is write protected\n\r",current_drive);
@@ -260,6 +295,15 @@ static void rw_interrupt(void)
 		do_fd_request();
 		return;
 	}
+	if (cache_fill) {
+		// 整个柱面已读入 请求由do_fd_request()从缓存中完成
+		cache_drive = current_drive;
+		cache_type = floppy;
+		cache_track = track;
+		floppy_deselect(current_drive);
+		do_fd_request();
+		return;
+	}
 	if (command == FD_READ && (unsigned long)(CURRENT->buffer) >= 0x100000)
 		copy_buffer(tmp_floppy_area,CURRENT->buffer);
 	floppy_deselect(current_drive);
@@ -267,10 +311,14 @@ static void rw_interrupt(void)
 	do_fd_request();
 }
 
-inline void setup_rw_floppy(void)
+static inline void setup_rw_floppy(void)
 {
-	setup_DMA();
+	if (cache_fill)
+		setup_DMA(tmp_floppy_area,2*floppy->sect*512);
+	else
+		setup_DMA(CURRENT->buffer,BLOCK_SIZE);
 	do_floppy = rw_interrupt;
+	rw_start = jiffies;
 	output_byte(command);
 	output_byte(head<<2 | current_drive);
 	output_byte(track);
@@ -291,14 +339,28 @@ inline void setup_rw_floppy(void)
  */
 static void seek_interrupt(void)
 {
+	int ok;
+
+	fd_stat.seek++;
+	fd_stat.seek_ticks += jiffies - seek_start;
 /* sense drive status */
 	output_byte(FD_SENSEI);
-	if (result() != 2 || (ST0 & 0xF8) != 0x20 || ST1 != seek_track) {
+	ok = result() == 2 && (ST0 & 0xF8) == 0x20 && ST1 == seek_track;
+	if (ok)
+		current_track = ST1;
+	/* motor still spinning up: motor_on_interrupt() goes on from here */
+	if (overlap == 1) {
+		if (!ok)
+			bad_flp_intr();
+		overlap = 3;
+		return;
+	}
+	overlap = 0;
+	if (!ok) {
 		bad_flp_intr();
 		do_fd_request();
 		return;
 	}
-	current_track = ST1;
 	setup_rw_floppy();
 }
 
@@ -326,6 +388,7 @@ static void transfer(void)
 		return;
 	}
 	do_floppy = seek_interrupt;
+	seek_start = jiffies;
 	if (seek_track) {
 		output_byte(FD_SEEK);
 		output_byte(head<<2 | current_drive);
@@ -371,6 +434,35 @@ static void recalibrate_floppy(void)
 		do_fd_request();
 }
 
+/*
+ * 82077-type controllers can be told to do the seek themselves when a
+ * read or write is for another cylinder ("implied seeks"), which saves
+ * a seek command and its interrupt. A plain 765 takes CONFIGURE for an
+ * invalid command, and has a result byte (0x80) ready at once.
+ * A reset forgets it, so it is done again after each one.
+ */
+static void configure_fdc(void)
+{
+	int counter, status;
+
+	implied_seek = 0;
+	output_byte(FD_CONFIGURE);
+	for (counter = 0 ; counter < 10000 ; counter++) {
+		status = inb_p(FD_STATUS) & (STATUS_READY | STATUS_DIR);
+		if (status == (STATUS_READY | STATUS_DIR)) {
+			(void) result();
+			return;
+		}
+		if (status == STATUS_READY)
+			break;
+	}
+	output_byte(0);
+	output_byte(0x60);	/* implied seeks, no FIFO, drive polling */
+	output_byte(0);		/* write precompensation from track 0 */
+	if (!reset)
+		implied_seek = 1;
+}
+
 static void reset_interrupt(void)
 {
 	output_byte(FD_SENSEI);
@@ -378,6 +470,7 @@ static void reset_interrupt(void)
 	output_byte(FD_SPECIFY);
 	output_byte(cur_spec1);		/* hut etc */
 	output_byte(6);			/* Head load time =6ms, DMA */
+	configure_fdc();
 	do_fd_request();
 }
 
@@ -402,6 +495,23 @@ static void reset_floppy(void)
 	sti();
 }
 
+/// fd_timer到时
+static void fd_timer_fn(unsigned long unused)
+{
+	(*fd_resume)();
+}
+
+/// ticks个滴答后调用fn 为0则马上调用
+static void fd_delay(int ticks, void (*fn)(void))
+{
+	if (ticks <= 0) {
+		(*fn)();
+		return;
+	}
+	fd_resume = fn;
+	start_timer(&fd_timer,ticks);
+}
+
 static void floppy_on_interrupt(void)
 {
 /* We cannot do a floppy-select, as that might sleep. We just force it */
@@ -410,16 +520,67 @@ static void floppy_on_interrupt(void)
 		current_DOR &= 0xFC;
 		current_DOR |= current_drive;
 		outb(current_DOR,FD_DOR);
-		add_timer(2,&transfer);
+		fd_delay(2,&transfer);
 	} else
 		transfer();
 }
 
+/*
+ * The motor is up, after a seek was started while it spun up. If
+ * do_fd_request() has been called since, overlap is 0 and it is taken
+ * care of already.
+ */
+static void motor_on_interrupt(unsigned long unused)
+{
+	if (overlap == 1)
+		overlap = 2;
+	else if (overlap == 3) {
+		overlap = 0;
+		do_fd_request();
+	}
+}
+
+/// req是否不用寻道就能做: 在磁头所在的柱面上 或者能从缓存读
+static int fd_here(struct request * req)
+{
+	struct floppy_struct * f = (MINOR(req->dev)>>2) + floppy_type;
+	unsigned int cyl;
+
+	if (DRIVE(req->dev) != current_drive || !f->sect || req->cmd == FLUSH)
+		return 0;
+	cyl = req->sector / (f->sect * f->head);
+	if (req->cmd == READ && cache_drive == current_drive &&
+	    cache_type == f && cache_track == cyl)
+		return 1;
+	return (cyl << f->stretch) == current_track;
+}
+
+/*
+ * Before seeking away from the cylinder the head is on, do the requests
+ * queued for it, up to the first barrier. Not when CURRENT has waited
+ * too long already.
+ */
+static void fd_batch(void)
+{
+	struct request * req;
+
+	if (CURRENT->expires <= jiffies || fd_here(CURRENT))
+		return;
+	for (req = CURRENT->next ; req && req->cmd != FLUSH ; req = req->next)
+		if (fd_here(req)) {
+			promote_request(DEVICE_QUEUE,req);
+			fd_stat.batched++;
+			return;
+		}
+}
+
 void do_fd_request(void)
 {
 	unsigned int block;
+	int ticks;
 
 	seek = 0;
+	overlap = 0;
 	if (reset) {
 		reset_floppy();
 		return;
@@ -429,6 +590,12 @@ void do_fd_request(void)
 		return;
 	}
 	INIT_REQUEST;
+	/* the controller caches nothing: a flush is done at once */
+	if (CURRENT->cmd == FLUSH) {
+		end_request(1);
+		goto repeat;
+	}
+	fd_batch();
 	floppy = (MINOR(CURRENT->dev)>>2) + floppy_type;
 	if (current_drive != CURRENT_DEV)
 		seek = 1;
@@ -443,16 +610,74 @@ void do_fd_request(void)
 	head = block % floppy->head;
 	track = block / floppy->head;
 	seek_track = track << floppy->stretch;
-	if (seek_track != current_track)
-		seek = 1;
-	sector++;
-	if (CURRENT->cmd == READ)
+	cache_fill = 0;
+	if (CURRENT->cmd == READ) {
+		if (cache_drive == current_drive && cache_type == floppy &&
+		    cache_track == track) {
+			copy_buffer(tmp_floppy_area +
+				(head*floppy->sect + sector)*512,CURRENT->buffer);
+			fd_stat.cache_hits++;
+			end_request(1);
+			goto repeat;
+		}
 		command = FD_READ;
-	else if (CURRENT->cmd == WRITE)
+		/*
+		 * Read the whole cylinder: with MT set, the controller goes
+		 * on with head 1 after the last sector of head 0. If that
+		 * keeps failing, read just the block, a bad sector elsewhere
+		 * on the cylinder mustn't make it unreadable.
+		 */
+		if (CURRENT->errors < MAX_ERRORS/2) {
+			cache_fill = 1;
+			cache_drive = -1;
+			head = 0;
+			sector = 0;
+		}
+	} else if (CURRENT->cmd == WRITE) {
 		command = FD_WRITE;
-	else
+		if (cache_drive == current_drive && cache_track == track)
+			cache_drive = -1;
+	} else
 		panic("do_fd_request: unknown command");
-	add_timer(ticks_to_floppy_on(current_drive),&floppy_on_interrupt);
+	if (seek_track != current_track)
+		seek = 1;
+	/* the controller steps to 'track' itself, unless tracks are doubled */
+	if (seek && implied_seek && !floppy->stretch) {
+		seek = 0;
+		current_track = seek_track;
+	}
+	sector++;
+	if (ticks = ticks_to_floppy_on(current_drive)) {
+		fd_stat.motor++;
+		fd_stat.motor_ticks += ticks;
+	}
+	if (ticks && seek && !motor_timer.next &&
+	    (current_DOR & 3) == current_drive) {
+		selected = 1;
+		overlap = 1;
+		start_timer(&motor_timer,ticks);
+		transfer();
+	} else
+		fd_delay(ticks,&floppy_on_interrupt);
+}
+
+/*
+ * Floppy ioctls: FDGETSTAT, and those of all block devices.
+ */
+int fd_ioctl(int dev, int cmd, int arg)
+{
+	int i;
+
+	if (cmd != FDGETSTAT)
+		return blk_ioctl(dev,cmd,arg);
+	verify_area((void *) arg,sizeof(fd_stat));
+	cli();
+	for (i = 0 ; i < sizeof(fd_stat)/sizeof(long) ; i++) {
+		put_fs_long(((unsigned long *) &fd_stat)[i],i+(unsigned long *) arg);
+		((unsigned long *) &fd_stat)[i] = 0;
+	}
+	sti();
+	return 0;
 }
 
 static int floppy_sizes[] ={
@@ -470,6 +695,11 @@ void floppy_init(void)
 {
 	blk_size[MAJOR_NR] = floppy_sizes;
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	// 软驱很慢 不让它占用太多请求项
+	blk_dev[MAJOR_NR].max_requests = NR_REQUEST/4;
+	fd_timer.fn = fd_timer_fn;
+	motor_timer.fn = motor_on_interrupt;
 	set_trap_gate(0x26,&floppy_interrupt);
 	outb(inb_p(0x21)&~0x40,0x21);
+	configure_fdc();
 }
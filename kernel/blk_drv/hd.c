@@ -23,8 +23,50 @@
 #include <asm/segment.h>
 
 #define MAJOR_NR 3
+
+/*
+ * Every drive has a request queue of its own. A channel (a controller
+ * with its own ports and irq) does one command at a time, for one of
+ * its drives: drives on different channels work in parallel, the master
+ * and slave of a channel take turns. hd_chan is the channel being dealt
+ * with: everything below works on it. The interrupt, timer and request
+ * entry points set it, and put it back when done, as they may nest.
+ */
+#define MAX_HD_CHAN	2
+
+struct hd_channel {
+	int base;						// 命令寄存器组端口 0x1f0/0x170
+	int ctl;						// 控制寄存器端口 0x3f6/0x376
+	struct blk_dev_struct * queue;	// 正在处理的硬盘请求队列
+	void (*intr)(void);				// 等待的中断处理函数
+	struct timer_list timeout;		// 中断超时的定时器
+	int reset;						// 复位标记
+	int recalibrate;				// 重新校正标记
+	struct timer_list timer;		// 等控制器的定时器
+	int waited;						// 已等待的滴答数
+	void (*resume)(void);			// 定时器到时调用的函数
+	int nsect;						// 最近一次发给硬盘的写扇区数
+	int reset_drive;				// 复位后正在设置参数的硬盘
+#ifdef HD_DMA
+	int bm_base;					// 总线主控DMA寄存器端口 0表示没有
+	struct prd * prd_table;			// 该通道的PRD表
+#endif
+};
+
+static struct hd_channel hd_channel[MAX_HD_CHAN] = {
+	{ 0x1f0, 0x3f6 },
+	{ 0x170, 0x376 }
+};
+/* not static: end_request() in blk.h gets CURRENT through it */
+struct hd_channel * hd_chan = hd_channel;
+
 #include "blk.h"
 
+// 当前通道上的端口 reg为<linux/hdreg.h>中主通道的HD_xxx
+#define PORT(reg) ((reg)-HD_DATA+hd_chan->base)
+// 设置当前通道的中断函数，并同时设置超时
+#define SET_INTR(x) (hd_chan->intr = (x),start_timer(&hd_chan->timeout,200))
+
 #define CMOS_READ(addr) ({ \
 outb_p(0x80|addr,0x70); \
 inb_p(0x71); \
@@ -41,10 +83,21 @@ static void recal_intr(void);
 // 结束该次请求项 会设置重试标记
 static void bad_rw_intr(void);
 
-// 重新校正标记， 设置后，程序会调用recal_intr 将磁头移动到0柱面
-static int recalibrate = 0;
-// 复位标记
-static int reset = 0;
+/*
+ * Drives that can do it are put in multiple mode: READ/WRITE MULTIPLE
+ * then move up to 'mult' sectors per interrupt instead of one. The
+ * commands needed to get there are done ahead of the next request, as
+ * recalibrate is: 'special' says which are still to be done.
+ */
+#define MAX_MULT	16		// 每次中断最多传送的扇区数
+#define SPEC_IDENTIFY	1	// 要发送IDENTIFY命令
+#define SPEC_SETMULT	2	// 要发送SET MULTIPLE MODE命令
+
+static void identify_intr(void);
+static void setmult_intr(void);
+
+// IDENTIFY命令读回的数据
+static unsigned short hd_ident[256];
 
 /*
  *  This struct defines the HD's and their types.
@@ -57,6 +110,12 @@ struct hd_i_struct {
 	int wpcom;			// 写前补偿柱面号
 	int lzone;			// 磁头着陆区柱面号
 	int ctl;			// 控制字节
+	int mult;			// 多扇区模式下每次中断的扇区数 0表示不用
+	int special;		// 尚待发送的SPEC_xxx命令
+	int dma;			// 使用总线主控DMA
+	int lba;			// 寻址方式 0#CHS | 28#LBA28 | 48#LBA48
+	struct hd_channel * chan;	// 所在通道
+	int slave;			// 是通道上的从盘
 	};
 
 // 初始化硬盘结构信息
@@ -66,9 +125,11 @@ struct hd_i_struct hd_info[] = { HD_TYPE };
 #define NR_HD ((sizeof (hd_info))/(sizeof (struct hd_i_struct)))
 #else
 // 默认为0， 会在setup中设置
-struct hd_i_struct hd_info[] = { {0,0,0,0,0,0},{0,0,0,0,0,0} };
+struct hd_i_struct hd_info[] = { {0,0,0,0,0,0,0,0,0,0},{0,0,0,0,0,0,0,0,0,0} };
 static int NR_HD = 0;	// 硬盘数量
 #endif
+// hd_info[]的项数 HD_TYPE可能只定义了一个硬盘
+#define NR_HD_INFO ((sizeof (hd_info))/(sizeof (struct hd_i_struct)))
 
 // 定义硬盘分区结构
 // 给出每个分区从硬盘0道开始算起的物理其实扇区号和该分区的扇区总数
@@ -82,6 +143,9 @@ static struct hd_struct {
 // 硬盘每个分区的数据块总数组
 static int hd_sizes[5*MAX_HD] = {0, };
 
+// 每个硬盘的请求队列
+static struct blk_dev_struct hd_queue[MAX_HD];
+
 // 读端口 汇编宏， 读端口port，读取nr*2字节，保存在buff中
 #define port_read(port,buf,nr) \
 __asm__("cld;rep;insw"::"d" (port),"D" (buf),"c" (nr):"cx","di")
@@ -90,8 +154,105 @@ __asm__("cld;rep;insw"::"d" (port),"D" (buf),"c" (nr):"cx","di")
 #define port_write(port,buf,nr) \
 __asm__("cld;rep;outsw"::"d" (port),"S" (buf),"c" (nr):"cx","si")
 
+#ifdef HD_DMA
+/*
+ * Bus-master DMA: the controller moves the data of a whole request
+ * by itself, as described by the PRD table, and interrupts once at
+ * the end. Kernel memory is mapped 1:1, so the addresses of buffers
+ * are physical ones. Each channel has its own bus-master registers
+ * and PRD table.
+ */
+static void dma_intr(void);
+
+#define PCI_CONF_ADDR	0xCF8
+#define PCI_CONF_DATA	0xCFC
+
+/// 读PCI配置空间 (配置机制1)
+static unsigned long pci_read(int dev, int fn, int reg)
+{
+	outl(0x80000000 | (dev<<11) | (fn<<8) | reg, PCI_CONF_ADDR);
+	return inl(PCI_CONF_DATA);
+}
+
+/// 写PCI配置空间
+static void pci_write(int dev, int fn, int reg, unsigned long value)
+{
+	outl(0x80000000 | (dev<<11) | (fn<<8) | reg, PCI_CONF_ADDR);
+	outl(value, PCI_CONF_DATA);
+}
+
+/*
+ * Look for an IDE controller on PCI bus 0 that can be a bus master
+ * (class 0x0101, bit 7 of the programming interface).
+ */
+/// 查找支持总线主控DMA的PCI IDE控制器
+static void hd_dma_probe(void)
+{
+	unsigned long class,page;
+	int dev,fn,base;
+
+	outl(0x80000000,PCI_CONF_ADDR);
+	if (inl(PCI_CONF_ADDR) != 0x80000000)	// 没有PCI总线
+		return;
+	for (dev = 0 ; dev < 32 ; dev++)
+		for (fn = 0 ; fn < 8 ; fn++) {
+			if ((pci_read(dev,fn,0) & 0xffff) == 0xffff)
+				continue;
+			class = pci_read(dev,fn,8);
+			if ((class>>16) != 0x0101 || !(class & 0x8000))
+				continue;
+			if (!(base = pci_read(dev,fn,0x20) & 0xfffc))
+				continue;
+			// PRD表占半页 不会跨越64kB边界
+			if (!(page = get_free_page()))
+				return;
+			hd_channel[0].bm_base = base;
+			hd_channel[0].prd_table = (struct prd *) page;
+			hd_channel[1].bm_base = base+8;		// 从通道的寄存器在后8个端口
+			hd_channel[1].prd_table = (struct prd *) (page+PAGE_SIZE/2);
+			// 打开I/O空间访问和总线主控
+			pci_write(dev,fn,4,pci_read(dev,fn,4) | 5);
+			printk("hd: bus-master DMA at 0x%04x\n\r",base);
+			return;
+		}
+}
+
+/*
+ * Fill in the PRD table for what is left of CURRENT: one region per
+ * buffer, as the buffers needn't be next to each other in memory, or
+ * one for a page request. Then get the controller ready to go.
+ */
+/// 为CURRENT建立PRD表 并设置DMA控制器
+static void hd_dma_setup(void)
+{
+	struct prd * p = hd_chan->prd_table;
+	struct buffer_head * bh = CURRENT->bh;
+	char * buf = CURRENT->buffer;
+	unsigned long left = CURRENT->nr_sectors << 9;
+	unsigned long n;
+
+	while (left) {
+		n = bh ? (bh->b_data + BLOCK_SIZE - buf) : left;
+		if (n > left)
+			n = left;
+		p->addr = (unsigned long) buf;
+		p->count = n;
+		p++;
+		left -= n;
+		if (bh && (bh = bh->b_reqnext))
+			buf = bh->b_data;
+	}
+	p[-1].count |= PRD_EOT;
+	outb(0,hd_chan->bm_base+BM_COMMAND);
+	outl((unsigned long) hd_chan->prd_table,hd_chan->bm_base+BM_PRDT);
+	outb(BM_INTR|BM_ERROR,hd_chan->bm_base+BM_STATUS);	// 写1清除
+	outb((CURRENT->cmd == READ) ? BM_READ : 0,hd_chan->bm_base+BM_COMMAND);
+}
+#endif
+
 // 硬盘中断 定义在 sys_call.s
 extern void hd_interrupt(void);
+extern void hd2_interrupt(void);
 // 虚拟盘创建加载函数 定义在 ramdisk.c
 extern void rd_load(void);
 
@@ -130,6 +291,7 @@ int sys_setup(void * BIOS)
 		NR_HD=1;
 #endif
 	for (i=0 ; i<NR_HD ; i++) {
+		hd_info[i].special = SPEC_IDENTIFY;	// 第一个请求前先查询硬盘能力
 		hd[i*5].start_sect = 0;	// 设置起始扇区号
 		hd[i*5].nr_sects = hd_info[i].head* 			// 总扇区数=磁头数*每磁道扇区数*柱面数
 				hd_info[i].sect*hd_info[i].cyl;
@@ -208,29 +370,52 @@ int sys_setup(void * BIOS)
 	return (0);
 }
 
-// 等待硬盘控制器准备就绪
-// reutrn = >0#表示在设定时间内ok | =0#表示等待超时，设定时间内还是没有准备好
+/*
+ * Nothing in here spins on the status register: if the controller isn't
+ * ready yet, we look again a tick later, from a timer. 'waited' counts
+ * the ticks waited so far, and 'timer' is the timer: while it is
+ * pending, do_hd_request() does nothing.
+ */
+#define HD_WAIT		(HZ/10)		// 等控制器就绪/DRQ的最长时间
+#define HD_RESET_WAIT	(30*HZ)		// 复位后等硬盘就绪的最长时间 硬盘可能要重新起转
+
+/// 通道的定时器到时 data为通道
+static void hd_timer_fn(unsigned long data)
+{
+	struct hd_channel * old = hd_chan;
+
+	hd_chan = (struct hd_channel *) data;
+	(*hd_chan->resume)();
+	hd_chan = old;
+}
+
+/// 一个滴答后再调用fn
+static void hd_retry(void (*fn)(void))
+{
+	hd_chan->resume = fn;
+	start_timer(&hd_chan->timer,1);
+}
+
+// 硬盘控制器是否准备就绪
+// return = 1#就绪 | 0#还没有准备好
 static int controller_ready(void)
 {
-	int retries = 100000;
-	// 0xc0 =  (SEEK_STAT | WRERR_STAT | READY_STAT | BUSY_STAT)
+	// 0xc0 =  (BUSY_STAT | READY_STAT)
 	// 0x40 = READY_STAT
-	// 这么写 应该是冗余的检测
-	while (--retries && (inb_p(HD_STATUS)&0xc0)!=0x40);
-	return (retries);
+	return (inb_p(PORT(HD_STATUS))&0xc0)==0x40;
 }
 
 // 检测硬盘执行命令后的状态，(win表示温切斯特硬盘的缩写)
 // return = 0#正常 | 1#出错 错误号在错误寄存器中HD_ERROR(0x1f1)
 static int win_result(void)
 {
-	int i=inb_p(HD_STATUS);
+	int i=inb_p(PORT(HD_STATUS));
 
 	// 这里是检测的  当前为  寻道和就绪 其他已复位
 	if ((i & (BUSY_STAT | READY_STAT | WRERR_STAT | SEEK_STAT | ERR_STAT))
 		== (READY_STAT | SEEK_STAT))
 		return(0); /* ok */
-	if (i&1) i=inb(HD_ERROR);  // 有错误读错误码
+	if (i&1) i=inb(PORT(HD_ERROR));  // 有错误读错误码
 	return (1);
 }
 
@@ -248,66 +433,124 @@ static void hd_out(
 
 	if (drive>1 || head>15)
 		panic("Trying to write bad sector");
-	if (!controller_ready())		// 等控制器就绪
-		panic("HD controller not ready");
 	SET_INTR(intr_addr);
-	outb_p(hd_info[drive].ctl,HD_CMD);
-	port=HD_DATA;
+	outb_p(hd_info[drive].ctl,hd_chan->ctl);
+	port=hd_chan->base;
 	outb_p(hd_info[drive].wpcom>>2,++port);	// 写预补偿柱面号 （需除以4？？）
 	outb_p(nsect,++port);					// 操作扇区总数 和读error同一个地址
 	outb_p(sect,++port);					// 起始扇区
 	outb_p(cyl,++port);						// 柱面号低8位
 	outb_p(cyl>>8,++port);					// 柱面号高8位
-	outb_p(0xA0|(drive<<4)|head,++port);	// 驱动器号+磁头号 公用
+	outb_p(0xA0|(hd_info[drive].slave<<4)|head,++port);	// 驱动器号+磁头号 公用
 	outb(cmd,++port);						// 刷命令  读/写
 }
 
-// 等待硬盘就绪
+/*
+ * Send a read/write command addressing the drive by LBA. Requests that
+ * reach beyond LBA28 are sent as the LBA48 command (the drive must
+ * have said it knows them): the high bytes go first, through the same
+ * registers. Our sector numbers are 32 bits, so bits 32-47 are 0.
+ */
+// 用LBA方式向硬盘控制器发送命令块
+static void hd_out_lba(unsigned int drive, unsigned int nsect,
+	unsigned long lba, unsigned int cmd, void (*intr_addr)(void))
+{
+	int ext = (lba + nsect > LBA28_MAX);
+
+	if (drive>1)
+		panic("Trying to write bad sector");
+	SET_INTR(intr_addr);
+	outb_p(hd_info[drive].ctl,hd_chan->ctl);
+	if (ext) {
+		outb_p(0,PORT(HD_NSECTOR));
+		outb_p(lba>>24,PORT(HD_SECTOR));
+		outb_p(0,PORT(HD_LCYL));
+		outb_p(0,PORT(HD_HCYL));
+		switch (cmd) {
+			case WIN_READ: cmd = WIN_READ_EXT; break;
+			case WIN_WRITE: cmd = WIN_WRITE_EXT; break;
+			case WIN_MULTREAD: cmd = WIN_MULTREAD_EXT; break;
+			case WIN_MULTWRITE: cmd = WIN_MULTWRITE_EXT; break;
+			case WIN_READDMA: cmd = WIN_READDMA_EXT; break;
+			case WIN_WRITEDMA: cmd = WIN_WRITEDMA_EXT; break;
+		}
+	}
+	outb_p(nsect,PORT(HD_NSECTOR));
+	outb_p(lba,PORT(HD_SECTOR));				// LBA 0-7位
+	outb_p(lba>>8,PORT(HD_LCYL));				// LBA 8-15位
+	outb_p(lba>>16,PORT(HD_HCYL));				// LBA 16-23位
+	// 0x40: LBA方式  LBA28的24-27位放在低4位
+	outb_p(0xE0|(hd_info[drive].slave<<4)|(ext ? 0 : (lba>>24) & 0x0f),PORT(HD_CURRENT));
+	outb(cmd,PORT(HD_COMMAND));
+}
+
+// 硬盘是否还在忙
 static int drive_busy(void)
 {
-	unsigned int i;
 	unsigned char c;
 
-	for (i = 0; i < 50000; i++) {
-		c = inb_p(HD_STATUS);
-		c &= (BUSY_STAT | READY_STAT | SEEK_STAT);
-		if (c == (READY_STAT | SEEK_STAT))
-			return 0;
-	}
-	printk("HD controller times out\n\r");
-	return(1);
+	c = inb_p(PORT(HD_STATUS));
+	c &= (BUSY_STAT | READY_STAT | SEEK_STAT);
+	return c != (READY_STAT | SEEK_STAT);
 }
 
+static void reset_release(void);
+static void reset_done(void);
+static void specify_next(void);
+static void reset_hd(void);
+
+/*
+ * Resetting is done in steps from the timer: raise the reset line,
+ * drop it a tick later, and then wait for the drives to be ready,
+ * which can take long if they have to spin up again.
+ */
 // 尝试复位控制器
 static void reset_controller(void)
 {
-	int	i;
+	hd_chan->intr = NULL;
+	stop_timer(&hd_chan->timeout);
+	outb(4,hd_chan->ctl);			// 发送复位信号
+	hd_chan->waited = 0;
+	hd_retry(&reset_release);
+}
 
-	outb(4,HD_CMD);			// 发送复位新号
-	for(i = 0; i < 1000; i++) nop();	// 空等
-	outb(hd_info[0].ctl & 0x0f ,HD_CMD);
-	if (drive_busy())
+// 结束复位信号
+static void reset_release(void)
+{
+	outb(hd_info[hd_chan->queue-hd_queue].ctl & 0x0f ,hd_chan->ctl);
+	hd_retry(&reset_done);
+}
+
+// 等复位完成 然后逐个设置硬盘参数
+static void reset_done(void)
+{
+	int i;
+
+	if (drive_busy()) {
+		if (++hd_chan->waited < HD_RESET_WAIT) {
+			hd_retry(&reset_done);
+			return;
+		}
 		printk("HD-controller still busy\n\r");
-	if ((i = inb(HD_ERROR)) != 1)
+	}
+	hd_chan->waited = 0;
+	if ((i = inb(PORT(HD_ERROR))) != 1)
 		printk("HD-controller reset failed: %02x\n\r",i);
+	// 复位后硬盘会退出多扇区模式
+	for (i = 0 ; i < NR_HD ; i++)
+		if (hd_info[i].chan == hd_chan && hd_info[i].mult)
+			hd_info[i].special |= SPEC_SETMULT;
+	hd_chan->reset_drive = -1;
+	specify_next();
 }
 
-// 硬盘复位操作
-static void reset_hd(void)
+// 给通道上的下一个硬盘发送WIN_SPECIFY 都做完了就继续处理请求
+static void specify_next(void)
 {
-	static int i;
+	int i = ++hd_chan->reset_drive;
 
-repeat:
-	if (reset) {
-		reset = 0;
-		i = -1;
-		reset_controller();
-	} else if (win_result()) {
-		bad_rw_intr();
-		if (reset)
-			goto repeat;
-	}
-	i++;
+	while (i < NR_HD && hd_info[i].chan != hd_chan)
+		i = ++hd_chan->reset_drive;
 	if (i < NR_HD) {
 		hd_out(i,hd_info[i].sect,hd_info[i].sect,hd_info[i].head-1,
 			hd_info[i].cyl,WIN_SPECIFY,&reset_hd);
@@ -315,11 +558,24 @@ repeat:
 		do_hd_request();
 }
 
+// 硬盘复位操作 也是WIN_SPECIFY的中断处理函数
+static void reset_hd(void)
+{
+	if (!hd_chan->reset && win_result())
+		bad_rw_intr();
+	if (hd_chan->reset) {
+		hd_chan->reset = 0;
+		reset_controller();
+		return;
+	}
+	specify_next();
+}
+
 // 硬盘意外中断调用的默认函数
-void unexpected_hd_interrupt(void)
+static void unexpected_hd_interrupt(void)
 {
 	printk("Unexpected HD interrupt\n\r");
-	reset = 1;
+	hd_chan->reset = 1;
 	do_hd_request();
 }
 
@@ -331,44 +587,204 @@ static void bad_rw_intr(void)
 	if (++CURRENT->errors >= MAX_ERRORS)
 		end_request(0);
 	if (CURRENT->errors > MAX_ERRORS/2)
-		reset = 1;
+		hd_chan->reset = 1;
+}
+
+/*
+ * A request may hold several buffers: every time a whole block has been
+ * transferred the buffer is finished with end_request(), which moves the
+ * request on to the next buffer while the drive keeps going.
+ */
+#define BLOCK_DONE(nr) (!(nr) || (CURRENT->bh && !((nr) & 1)))
+
+/*
+ * The nr of sectors the drive moves per interrupt for CURRENT: one,
+ * or in multiple mode up to 'mult'.
+ */
+/// 本次中断要传送的扇区数
+static int hd_chunk(void)
+{
+	int n = hd_info[CURRENT_DEV].mult;
+
+	if (!n)
+		return 1;
+	return (n < CURRENT->nr_sectors) ? n : CURRENT->nr_sectors;
+}
+
+/*
+ * Write the next nr sectors of CURRENT to the drive. They may cover
+ * several buffers, which needn't be next to each other in memory.
+ */
+/// 向硬盘写CURRENT接下来的nr个扇区
+static void write_sectors(int nr)
+{
+	char * buf = CURRENT->buffer;
+	struct buffer_head * bh = CURRENT->bh;
+
+	while (nr-- > 0) {
+		port_write(PORT(HD_DATA),buf,256);
+		buf += 512;
+		if (bh && buf == bh->b_data+BLOCK_SIZE && (bh = bh->b_reqnext))
+			buf = bh->b_data;
+	}
 }
 
 // 读扇区中断中断调用函数
 static void read_intr(void)
 {
+	int i,n;
+
 	if (win_result()) {
 		bad_rw_intr();
 		do_hd_request();
 		return;
 	}
-	port_read(HD_DATA,CURRENT->buffer,256);
-	CURRENT->errors = 0;
-	CURRENT->buffer += 512;
-	CURRENT->sector++;
-	if (--CURRENT->nr_sectors) {
+	n = hd_chunk();
+	do {
+		port_read(PORT(HD_DATA),CURRENT->buffer,256);
+		CURRENT->errors = 0;
+		CURRENT->buffer += 512;
+		CURRENT->sector++;
+		i = --CURRENT->nr_sectors;
+		if (BLOCK_DONE(i))
+			end_request(1);
+	} while (i && --n);
+	if (i) {
 		// 未读完，继续
 		SET_INTR(&read_intr);
 		return;
 	}
 	// 读操作结束
-	end_request(1);
 	do_hd_request();
 }
 
 // 写扇区 中断调用函数
 static void write_intr(void)
 {
+	int i,n = hd_chan->nsect;
+
 	if (win_result()) {
 		bad_rw_intr();
 		do_hd_request();
 		return;
 	}
-	if (--CURRENT->nr_sectors) {
+	do {
 		CURRENT->sector++;
 		CURRENT->buffer += 512;
+		i = --CURRENT->nr_sectors;
+		if (BLOCK_DONE(i))
+			end_request(1);
+	} while (i && --n);
+	if (i) {
 		SET_INTR(&write_intr);
-		port_write(HD_DATA,CURRENT->buffer,256);
+		write_sectors(hd_chan->nsect = hd_chunk());
+		return;
+	}
+	do_hd_request();
+}
+
+/*
+ * IDENTIFY is done once per drive. Drives that don't know it (old
+ * ST-506 ones) just stay with one sector per interrupt.
+ */
+/// IDENTIFY命令的中断处理 取得硬盘支持的多扇区数
+static void identify_intr(void)
+{
+	int drive = CURRENT_DEV;
+	unsigned long nr;
+	int n;
+
+	if (win_result()) {
+		printk("hd%d: IDENTIFY failed\n\r",drive);
+		do_hd_request();
+		return;
+	}
+	port_read(PORT(HD_DATA),hd_ident,256);
+	n = hd_ident[ID_MAX_MULTSECT] & 0xff;
+	if (n > MAX_MULT)
+		n = MAX_MULT;
+	// 取不大于n的2的幂
+	while (n & (n-1))
+		n &= n-1;
+	if (n > 1) {
+		hd_info[drive].mult = n;
+		hd_info[drive].special |= SPEC_SETMULT;
+	}
+#ifdef HD_DMA
+	if (hd_chan->bm_base && (hd_ident[ID_CAPABILITY] & 0x100)) {
+		hd_info[drive].dma = 1;
+		printk("hd%d: using bus-master DMA\n\r",drive);
+	}
+#endif
+	// 支持LBA的硬盘 用IDENTIFY给出的容量代替BIOS的CHS参数
+	if (hd_ident[ID_CAPABILITY] & 0x200) {
+		hd_info[drive].lba = 28;
+		nr = hd_ident[ID_LBA_SECTORS] |
+			((unsigned long) hd_ident[ID_LBA_SECTORS+1] << 16);
+		if (hd_ident[ID_COMMAND_SET2] & 0x400) {
+			hd_info[drive].lba = 48;
+			if (hd_ident[ID_LBA48_SECTORS+2] || hd_ident[ID_LBA48_SECTORS+3])
+				nr = 0xffffffff;
+			else
+				nr = hd_ident[ID_LBA48_SECTORS] |
+					((unsigned long) hd_ident[ID_LBA48_SECTORS+1] << 16);
+		}
+		if (nr > 0x7fffffff)	// nr_sects是long
+			nr = 0x7fffffff;
+		hd[drive*5].nr_sects = nr;
+		printk("hd%d: LBA%d, %d sectors\n\r",drive,hd_info[drive].lba,nr);
+	}
+	do_hd_request();
+}
+
+/// SET MULTIPLE MODE命令的中断处理
+static void setmult_intr(void)
+{
+	int drive = CURRENT_DEV;
+
+	if (win_result()) {
+		printk("hd%d: can't set multiple mode\n\r",drive);
+		hd_info[drive].mult = 0;
+	} else
+		printk("hd%d: %d sectors per interrupt\n\r",drive,
+			hd_info[drive].mult);
+	do_hd_request();
+}
+
+/*
+ * The drive doesn't interrupt before the first sector of a write, it
+ * just sets DRQ when it wants the data. We look right away, and if it
+ * isn't there yet, once a tick after that.
+ */
+/// 等硬盘要数据(DRQ) 然后写出第一批扇区
+static void write_ready(void)
+{
+	if (!(inb_p(PORT(HD_STATUS)) & DRQ_STAT)) {
+		if (++hd_chan->waited < HD_WAIT) {
+			hd_retry(&write_ready);
+			return;
+		}
+		// 超时处理
+		hd_chan->waited = 0;
+		bad_rw_intr();
+		do_hd_request();
+		return;
+	}
+	hd_chan->waited = 0;
+	// 发数据给硬盘控制器
+	write_sectors(hd_chan->nsect = hd_chunk());
+}
+
+/*
+ * Drives without a write cache may not know FLUSH CACHE, and abort it:
+ * then there is nothing to flush.
+ */
+/// FLUSH CACHE命令的中断处理
+static void flush_intr(void)
+{
+	if (win_result() && !(inb(PORT(HD_ERROR)) & ABRT_ERR)) {
+		bad_rw_intr();
+		do_hd_request();
 		return;
 	}
 	end_request(1);
@@ -383,106 +799,298 @@ static void recal_intr(void)
 	do_hd_request();
 }
 
+#ifdef HD_DMA
+/*
+ * The whole request has been moved: finish all its buffers. If the
+ * controller reports an error, the drive goes back to programmed I/O.
+ */
+/// DMA传送结束的中断处理
+static void dma_intr(void)
+{
+	struct request * req = CURRENT;
+	int status = inb(hd_chan->bm_base+BM_STATUS);
+
+	outb(0,hd_chan->bm_base+BM_COMMAND);		// 停止DMA
+	outb(status|BM_INTR|BM_ERROR,hd_chan->bm_base+BM_STATUS);
+	if (status & BM_ERROR) {
+		printk("hd%d: DMA error, using PIO\n\r",CURRENT_DEV);
+		hd_info[CURRENT_DEV].dma = 0;
+	}
+	if ((status & BM_ERROR) || win_result()) {
+		bad_rw_intr();
+		do_hd_request();
+		return;
+	}
+	do
+		end_request(1);
+	while (CURRENT == req && req->bh);
+	do_hd_request();
+}
+#endif
+
 // 硬盘操作超时处理函数
-void hd_times_out(void)
+static void hd_times_out(void)
 {
 	if (!CURRENT)
 		return;
 	printk("HD timeout");
+#ifdef HD_DMA
+	if (hd_chan->bm_base)
+		outb(0,hd_chan->bm_base+BM_COMMAND);		// 停止可能在进行的DMA
+#endif
 	if (++CURRENT->errors >= MAX_ERRORS)
 		end_request(0);
-	SET_INTR(NULL);
-	reset = 1;
+	hd_chan->intr = NULL;
+	hd_chan->reset = 1;
 	do_hd_request();
 }
 
-// 执行硬盘读写请求操作
+/*
+ * Pick the queue the channel works on next: the one after the current
+ * one, among those of its drives that have requests, so that master and
+ * slave take turns. A request left half done is simply taken up again
+ * later, from what its 'sector' and 'nr_sectors' say.
+ */
+/// 轮流选择通道上有请求的硬盘队列 都没有请求返回0
+static int hd_select(void)
+{
+	struct blk_dev_struct * q = hd_chan->queue;
+	int i;
+
+	for (i = 0 ; i < MAX_HD ; i++) {
+		if (++q == hd_queue+MAX_HD)
+			q = hd_queue;
+		if (q-hd_queue < NR_HD_INFO &&
+		    hd_info[q-hd_queue].chan == hd_chan && q->current_request) {
+			hd_chan->queue = q;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// 执行当前通道的硬盘读写请求操作
 void do_hd_request(void)
 {
-	int i,r;
-	unsigned int block,dev;
+	unsigned int block,dev,drive;
 	unsigned int sec,head,cyl;
-	unsigned int nsect;
+	unsigned int nsect,cmd;
+	void (*intr)(void);
 
-/*
-INIT_REQUEST 展开
-repeat: 
-	if (!CURRENT) {
-		CLEAR_DEVICE_INTR 
-		CLEAR_DEVICE_TIMEOUT 
-		return; 
-	} 
-	if (MAJOR(CURRENT->dev) != MAJOR_NR) 
-		panic(DEVICE_NAME ": request list destroyed"); 
-	if (CURRENT->bh) { 
-		if (!CURRENT->bh->b_lock) 
-			panic(DEVICE_NAME ": block not locked"); 
-	}
-*/
-
-	INIT_REQUEST;
+	if (hd_chan->timer.next)	// 正在等控制器 定时器到时会继续
+		return;
+/* INIT_REQUEST, but looking at all the queues of the channel */
+repeat:
+	if (!hd_select()) {
+		hd_chan->intr = NULL;
+		stop_timer(&hd_chan->timeout);
+		return;
+	}
+	if (MAJOR(CURRENT->dev) != MAJOR_NR)
+		panic(DEVICE_NAME ": request list destroyed");
+	if (CURRENT->bh) {
+		if (!CURRENT->bh->b_lock)
+			panic(DEVICE_NAME ": block not locked");
+	}
 	dev = MINOR(CURRENT->dev);
-	block = CURRENT->sector;
-	// 检查有效性 block+2是因为每次至少操作2个扇区
-	if (dev >= 5*NR_HD || block+2 > hd[dev].nr_sects) {
+	if (dev >= 5*NR_HD) {
 		end_request(0);
 		goto repeat;
 	}
-	block += hd[dev].start_sect;	// 现在是物理扇区位置
-	dev /= 5;						// 硬盘全局信息 0/1
-	// 根据分区表信息 计算磁盘寻道坐标
-	//		代码等价
-	/*
-		sec = block % hd_info[dev].sect				// 得到扇区标记
-		block = block / hd_info[dev].sect			// 
-		cyl = block / /hd_info[dev].cyl				// 得到柱面号
-		head = block % hd_info[dev].cyl				// 得到磁道号
-		由此可反推 hdsect[cyl][head][sect] 物理扇区地址 = 
-			cyl * (dev.cyl * dev.sect) + head * dev.sect + sect
-	*/
-	__asm__("divl %4":"=a" (block),"=d" (sec):"0" (block),"1" (0),
-		"r" (hd_info[dev].sect));
-	__asm__("divl %4":"=a" (cyl),"=d" (head):"0" (block),"1" (0),
-		"r" (hd_info[dev].head));
-	sec++;		// 调整？ 为啥呢
-	nsect = CURRENT->nr_sectors;
-	if (reset) {
-		recalibrate = 1;
+	drive = dev/5;					// 硬盘全局信息 0/1
+	if (hd_chan->reset) {
+		hd_chan->recalibrate = 1;
 		reset_hd();		// 重置一下硬盘状态
 		return;
 	}
+	// 控制器还没准备好 一个滴答后再试
+	if (!controller_ready()) {
+		if (++hd_chan->waited < HD_WAIT) {
+			hd_retry(&do_hd_request);
+			return;
+		}
+		printk("HD controller not ready\n\r");
+		hd_chan->waited = 0;
+		bad_rw_intr();
+		hd_chan->reset = 1;
+		goto repeat;
+	}
+	hd_chan->waited = 0;
 	/// 校准
-	if (recalibrate) {
-		recalibrate = 0;
+	if (hd_chan->recalibrate) {
+		hd_chan->recalibrate = 0;
 		// 设置 恢复 硬盘会执行寻道操作，磁头停在0柱面
-		hd_out(dev,hd_info[CURRENT_DEV].sect,0,0,0,
+		hd_out(drive,hd_info[drive].sect,0,0,0,
 			WIN_RESTORE,&recal_intr);
 		return;
 	}	
-	if (CURRENT->cmd == WRITE) {
-		// 发送请求命令给硬盘控制器
-		// 并检测 请求是否准备就绪
-		hd_out(dev,nsect,sec,head,cyl,WIN_WRITE,&write_intr);
-		for(i=0 ; i<10000 && !(r=inb_p(HD_STATUS)&DRQ_STAT) ; i++)
-			/* nothing */ ;
-		if (!r) {
-			// 超时处理
-			bad_rw_intr();
-			goto repeat;
-		}
-		// 发数据给硬盘控制器
-		port_write(HD_DATA,CURRENT->buffer,256);
-	} else if (CURRENT->cmd == READ) {
-		hd_out(dev,nsect,sec,head,cyl,WIN_READ,&read_intr);
+	// 每个命令只试一次 失败了就不用多扇区模式
+	// IDENTIFY可能改变硬盘的大小 所以在检查请求之前做
+	if (hd_info[drive].special & SPEC_IDENTIFY) {
+		hd_info[drive].special &= ~SPEC_IDENTIFY;
+		hd_out(drive,0,0,0,0,WIN_IDENTIFY,&identify_intr);
+		return;
+	}
+	if (hd_info[drive].special & SPEC_SETMULT) {
+		hd_info[drive].special &= ~SPEC_SETMULT;
+		hd_out(drive,hd_info[drive].mult,0,0,0,WIN_SETMULT,&setmult_intr);
+		return;
+	}
+	// 刷新写缓存 对整个硬盘
+	if (CURRENT->cmd == FLUSH) {
+		hd_out(drive,0,0,0,0,(hd_info[drive].lba == 48) ?
+			WIN_FLUSH_EXT : WIN_FLUSH,&flush_intr);
+		return;
+	}
+	block = CURRENT->sector;
+	nsect = CURRENT->nr_sectors;
+	// 检查有效性 请求项可能包含多个块
+	if (block+nsect > hd[dev].nr_sects ||
+	    (hd_info[drive].lba == 28 && block+nsect+hd[dev].start_sect > LBA28_MAX+1)) {
+		end_request(0);
+		goto repeat;
+	}
+	block += hd[dev].start_sect;	// 现在是物理扇区位置
+	if (CURRENT->cmd == READ) {
+		cmd = hd_info[drive].mult ? WIN_MULTREAD : WIN_READ;
+		intr = &read_intr;
+	} else if (CURRENT->cmd == WRITE) {
+		cmd = hd_info[drive].mult ? WIN_MULTWRITE : WIN_WRITE;
+		intr = &write_intr;
 	} else
 		panic("unknown hd-command");
+#ifdef HD_DMA
+	if (hd_info[drive].dma) {
+		hd_dma_setup();
+		cmd = (CURRENT->cmd == READ) ? WIN_READDMA : WIN_WRITEDMA;
+		intr = &dma_intr;
+	}
+#endif
+	// LBA硬盘直接给出扇区号 不用再换算
+	if (hd_info[drive].lba)
+		hd_out_lba(drive,nsect,block,cmd,intr);
+	else {
+		// 根据分区表信息 计算磁盘寻道坐标
+		//		代码等价
+		/*
+			sec = block % hd_info[dev].sect				// 得到扇区标记
+			block = block / hd_info[dev].sect			// 
+			cyl = block / /hd_info[dev].cyl				// 得到柱面号
+			head = block % hd_info[dev].cyl				// 得到磁道号
+			由此可反推 hdsect[cyl][head][sect] 物理扇区地址 = 
+				cyl * (dev.cyl * dev.sect) + head * dev.sect + sect
+		*/
+		__asm__("divl %4":"=a" (block),"=d" (sec):"0" (block),"1" (0),
+			"r" (hd_info[drive].sect));
+		__asm__("divl %4":"=a" (cyl),"=d" (head):"0" (block),"1" (0),
+			"r" (hd_info[drive].head));
+		sec++;		// 调整？ 为啥呢
+		hd_out(drive,nsect,sec,head,cyl,cmd,intr);
+	}
+#ifdef HD_DMA
+	if (hd_info[drive].dma) {
+		outb(inb(hd_chan->bm_base+BM_COMMAND)|BM_START,
+			hd_chan->bm_base+BM_COMMAND);
+		return;
+	}
+#endif
+	if (CURRENT->cmd == WRITE)
+		write_ready();		// 等硬盘要数据 写出第一批扇区
+}
+
+/*
+ * The entry points from outside: each sets hd_chan to the channel it
+ * is about, and puts it back on the way out.
+ */
+/// 硬盘中断 由sys_call.s调用 nr为通道号
+void hd_intr(int nr)
+{
+	struct hd_channel * old = hd_chan;
+	void (*intr)(void);
+
+	hd_chan = hd_channel+nr;
+	stop_timer(&hd_chan->timeout);
+	if (!(intr = hd_chan->intr))
+		intr = &unexpected_hd_interrupt;
+	hd_chan->intr = NULL;
+	(*intr)();
+	hd_chan = old;
+}
+
+/// 通道的中断超时定时器到时 data为通道
+static void hd_timeout_fn(unsigned long data)
+{
+	struct hd_channel * old = hd_chan;
+
+	hd_chan = (struct hd_channel *) data;
+	hd_times_out();
+	hd_chan = old;
+}
+
+/*
+ * Called by add_request() when a queue gets its first request: start
+ * the channels that have nothing to do. A busy channel gets to the
+ * queue when it is done with what it is doing.
+ */
+/// 硬盘队列的请求函数 启动空闲的通道
+static void hd_request(void)
+{
+	struct hd_channel * old = hd_chan;
+
+	for (hd_chan = hd_channel ; hd_chan < hd_channel+MAX_HD_CHAN ; hd_chan++)
+		if (!hd_chan->intr && !hd_chan->timer.next)
+			do_hd_request();
+	hd_chan = old;
+}
+
+/// 取硬盘设备dev的请求队列
+static struct blk_dev_struct * hd_get_queue(int dev)
+{
+	unsigned int drive = MINOR(dev)/5;
+
+	// 不存在的硬盘由do_hd_request()结束其请求
+	return hd_queue + ((drive < NR_HD_INFO) ? drive : 0);
 }
 
 // 硬盘系统初始化
 void hd_init(void)
 {
-	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;	// 设置请求函数指针
+	int i;
+
+	for (i = 0 ; i < NR_HD_INFO ; i++) {
+#ifdef HD_SECOND_CHANNEL
+		hd_info[i].chan = hd_channel+i;		// 各自是一个通道的主盘
+		hd_info[i].slave = 0;
+#else
+		hd_info[i].chan = hd_channel;		// 都在主通道上
+		hd_info[i].slave = i;
+#endif
+	}
+	for (i = 0 ; i < MAX_HD ; i++) {
+		hd_queue[i].request_fn = &hd_request;
+		hd_queue[i].current_request = NULL;
+		hd_queue[i].nr_requests = 0;
+		hd_queue[i].max_requests = NR_REQUEST;
+		set_iosched(hd_queue+i,DEF_IOSCHED);
+	}
+	hd_channel[0].queue = hd_queue;
+	hd_channel[1].queue = hd_queue+1;
+	for (i = 0 ; i < MAX_HD_CHAN ; i++) {
+		hd_channel[i].timer.fn = hd_timer_fn;
+		hd_channel[i].timeout.fn = hd_timeout_fn;
+		hd_channel[i].timer.data = hd_channel[i].timeout.data =
+			(unsigned long) (hd_channel+i);
+	}
+	blk_dev[MAJOR_NR].request_fn = &hd_request;	// 设置请求函数指针
+	blk_dev[MAJOR_NR].queue = &hd_get_queue;
+#ifdef HD_DMA
+	hd_dma_probe();
+#endif
 	set_intr_gate(0x2E,&hd_interrupt);				// 设置中断门处理函数指针
 	outb_p(inb_p(0x21)&0xfb,0x21);					// 复位主片屏蔽位?
 	outb(inb_p(0xA1)&0xbf,0xA1);					// 复位从片屏蔽位？
+#ifdef HD_SECOND_CHANNEL
+	set_intr_gate(0x2F,&hd2_interrupt);				// 从通道 IRQ15
+	outb(inb_p(0xA1)&0x7f,0xA1);
+#endif
 }
@@ -0,0 +1,257 @@
+/*
+ *  linux/kernel/blk_drv/iosched.c
+ */
+
+/*
+ * The I/O schedulers. Every block device has one, which sorts the new
+ * requests into its queue and picks the request the driver does next:
+ *
+ *	noop	 - requests are done in the order they come in.
+ *	cscan	 - the one-way elevator: the queue is kept in IN_ORDER
+ *		   order, and the head sweeps up, then starts over at the
+ *		   lowest sector. Page requests go first. So that a stream
+ *		   of writes can't starve a read, the oldest read that has
+ *		   expired is done next, ahead of the elevator order.
+ *	deadline - the elevator, but every request also goes on a read or
+ *		   a write FIFO. When the oldest request of a FIFO has
+ *		   expired it is done next, whatever the elevator order
+ *		   says. Reads expire much sooner.
+ *
+ * The first request of a queue is being worked on by the driver, and is
+ * never moved by any of them. FLUSH requests are barriers: add_request()
+ * puts them last, new requests are only sorted in behind the last one,
+ * and only requests ahead of the first one are done out of order.
+ */
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+
+#include "blk.h"
+
+/// noop: 加到队尾
+static void noop_add(struct blk_dev_struct * dev, struct request * req)
+{
+	struct request * tmp;
+
+	for (tmp = dev->current_request ; tmp->next ; tmp = tmp->next)
+		/* nothing */ ;
+	tmp->next = req;
+}
+
+/// 队列中最后一个屏障请求 没有则为队头 新请求只能排在它后面
+static struct request * queue_start(struct blk_dev_struct * dev)
+{
+	struct request * req, * start = dev->current_request;
+
+	for (req = start->next ; req ; req = req->next)
+		if (req->cmd == FLUSH)
+			start = req;
+	return start;
+}
+
+/// req是否排在第一个屏障请求之前
+static int before_barrier(struct request * head, struct request * req)
+{
+	struct request * tmp;
+
+	for (tmp = head->next ; tmp != req ; tmp = tmp->next)
+		if (tmp->cmd == FLUSH)
+			return 0;
+	return 1;
+}
+
+/// 按队列顺序取下一个请求项
+static struct request * queue_next(struct blk_dev_struct * dev)
+{
+	return dev->current_request->next;
+}
+
+/// 把req移到队列头之后 即作为下一个请求项
+static void move_next(struct request * head, struct request * req)
+{
+	struct request * tmp;
+
+	if (req == head->next)
+		return;
+	for (tmp = head ; tmp->next != req ; tmp = tmp->next)
+		/* nothing */ ;
+	tmp->next = req->next;
+	req->next = head->next;
+	head->next = req;
+}
+
+/*
+ * Note that swapping requests always go before other requests,
+ * and are done in the order they appear.
+ */
+/// C-SCAN电梯算法: 把req插入到请求队列中
+static void cscan_add(struct blk_dev_struct * dev, struct request * req)
+{
+	struct request * tmp;
+
+	for (tmp = queue_start(dev) ; tmp->next ; tmp=tmp->next) {
+		if (!req->bh)  // 请求没有设置缓冲区
+			// 后续请求节点有缓冲区，退出循环
+			if (tmp->next->bh)
+				break;
+			else
+				continue;
+
+		// 找到插入请求的位置
+		/*
+			判断式等价于
+			(tmp < req || tmp >= tmp->next) && (req < tmp->next)
+			又等价于
+			(tmp < req && req < tmp->next)  ||   // 表示当前的请求顺序是 从小到大 req 刚好可以插入到中间
+			(tmp >= tmp->next && req < tmp->next)  // 表示当前的请求顺序是 从大到小，
+			                                         实际应该插入到tmp->next 但还是插入到tmp后，表示让req当转向节点
+		*/
+		if ((IN_ORDER(tmp,req) || !IN_ORDER(tmp,tmp->next)) &&
+		    IN_ORDER(req,tmp->next))
+			break;
+	}
+	// 插入到temp后面
+	req->next=tmp->next;
+	tmp->next=req;
+}
+
+/// C-SCAN: 有已超时的读请求就先做最早的那个 否则按电梯顺序
+static struct request * cscan_next(struct blk_dev_struct * dev)
+{
+	struct request * head = dev->current_request;
+	struct request * req, * old = NULL;
+
+	for (req = head->next ; req && req->cmd != FLUSH ; req = req->next)
+		if (req->cmd == READ && req->expires <= jiffies &&
+		    (!old || req->start < old->start))
+			old = req;
+	if (old)
+		move_next(head,old);
+	return head->next;
+}
+
+/*
+ * The deadline FIFOs are circular lists through fifo_next/fifo_prev,
+ * dev->fifo[rw] being the oldest request. A request leaves its FIFO
+ * when it gets to the head of the queue. A request that isn't on a
+ * FIFO has fifo_next == NULL.
+ */
+/// 把req加到读/写FIFO的末尾
+static void fifo_add(struct blk_dev_struct * dev, struct request * req)
+{
+	struct request * head;
+
+	if (!(head = dev->fifo[req->cmd])) {
+		dev->fifo[req->cmd] = req->fifo_next = req->fifo_prev = req;
+		return;
+	}
+	req->fifo_next = head;
+	req->fifo_prev = head->fifo_prev;
+	head->fifo_prev->fifo_next = req;
+	head->fifo_prev = req;
+}
+
+/// 把req从读/写FIFO中取下
+static void fifo_del(struct blk_dev_struct * dev, struct request * req)
+{
+	if (!req->fifo_next)
+		return;
+	if (req->fifo_next == req)
+		dev->fifo[req->cmd] = NULL;
+	else {
+		req->fifo_next->fifo_prev = req->fifo_prev;
+		req->fifo_prev->fifo_next = req->fifo_next;
+		if (dev->fifo[req->cmd] == req)
+			dev->fifo[req->cmd] = req->fifo_next;
+	}
+	req->fifo_next = req->fifo_prev = NULL;
+}
+
+/// deadline: 按电梯顺序插入 同时加入FIFO
+static void deadline_add(struct blk_dev_struct * dev, struct request * req)
+{
+	cscan_add(dev,req);
+	fifo_add(dev,req);
+}
+
+/// deadline: 有超时的请求(读优先)就先做它 否则按电梯顺序
+static struct request * deadline_next(struct blk_dev_struct * dev)
+{
+	struct request * head = dev->current_request;
+	struct request * req;
+
+	if (!(req = dev->fifo[READ]) || req->expires > jiffies ||
+	    !before_barrier(head,req))
+		if (!(req = dev->fifo[WRITE]) || req->expires > jiffies ||
+		    !before_barrier(head,req))
+			req = NULL;
+	if (req)
+		move_next(head,req);
+	if (req = head->next)
+		fifo_del(dev,req);
+	return req;
+}
+
+/// I/O调度器表 下标为IOSCHED_xxx
+struct iosched iosched[NR_IOSCHED] = {
+	{ "noop", 100, noop_add, queue_next },
+	{ "cscan", 66, cscan_add, cscan_next },
+	{ "deadline", 66, deadline_add, deadline_next }
+};
+
+/*
+ * Called from end_request() when the request at the head of the queue
+ * is done: lets the scheduler pick the next one, and keeps track of the
+ * longest time a request has waited in the queue before the driver got
+ * to it.
+ */
+/// 取下一个请求项 并记录请求项在队列中的最长等待时间
+struct request * next_request(struct blk_dev_struct * dev)
+{
+	struct request * req;
+	unsigned long wait;
+
+	if ((req = (dev->sched->next_request)(dev)) && req->cmd != FLUSH) {
+		wait = jiffies - req->start;
+		if (wait > dev->max_wait[req->cmd])
+			dev->max_wait[req->cmd] = wait;
+	}
+	return req;
+}
+
+/*
+ * Called by a driver that hasn't started on the request at the head of
+ * the queue yet, to do req (queued ahead of any barrier) first after
+ * all: the floppy does so with requests on the cylinder it is on. The
+ * old head goes right behind req.
+ */
+/// 把req提到队头 代替还没开始处理的队头请求项
+void promote_request(struct blk_dev_struct * dev, struct request * req)
+{
+	struct request * head = dev->current_request;
+	struct request * tmp;
+
+	for (tmp = head ; tmp->next != req ; tmp = tmp->next)
+		/* nothing */ ;
+	tmp->next = req->next;
+	req->next = head;
+	dev->current_request = req;
+	fifo_del(dev,req);
+}
+
+/*
+ * Switch dev to scheduler nr. Requests already queued stay where they
+ * are, but are taken off the deadline FIFOs, so they never expire.
+ */
+/// 设置设备的I/O调度器
+void set_iosched(struct blk_dev_struct * dev, int nr)
+{
+	struct request * req;
+
+	cli();
+	for (req = dev->current_request ; req ; req = req->next)
+		req->fifo_next = req->fifo_prev = NULL;
+	dev->fifo[READ] = dev->fifo[WRITE] = NULL;
+	dev->sched = iosched + nr;
+	sti();
+}
@@ -8,23 +8,30 @@
  * This handles all read/write requests to block devices
  */
 #include <errno.h>
+#include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <asm/system.h>
+#include <asm/segment.h>
 
 #include "blk.h"
 
 /*
  * The request-struct contains all necessary data
- * to load a nr of sectors into memory
+ * to load a nr of sectors into memory. Free requests
+ * are kept on a list through req->next; the pool starts
+ * out empty and grows a page at a time when it runs dry.
  */
- // 请求队列  32
-struct request request[NR_REQUEST];
+ // 空闲请求项链表
+static struct request * free_requests = NULL;
+static int request_pages = 0;
 
 /*
- * used to wait on when there are no free requests
+ * used to wait on when there are no free requests: readers and
+ * writers wait apart, so that a freed request goes to a reader first.
  */
-struct task_struct * wait_for_request = NULL;
+static struct task_struct * wait_for_read = NULL;
+static struct task_struct * wait_for_write = NULL;
 
 /* blk_dev_struct is:
  *	do_request-address
@@ -38,7 +45,10 @@ struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
 	{ NULL, NULL },		/* dev hd */
 	{ NULL, NULL },		/* dev ttyx */
 	{ NULL, NULL },		/* dev tty */
-	{ NULL, NULL }		/* dev lp */
+	{ NULL, NULL },		/* dev lp */
+	{ NULL, NULL },		/* no_dev */
+	{ NULL, NULL },		/* no_dev */
+	{ NULL, NULL }		/* dev md */
 };
 
 /*
@@ -51,6 +61,29 @@ struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
  // 每个指定设备的块数量
 int * blk_size[NR_BLK_DEV] = { NULL, NULL, };
 
+/*
+ * The request queue of dev. There is one per major, unless the driver
+ * keeps several (hd has one per drive): then its 'queue' picks one.
+ */
+/// 取设备dev的请求队列
+static inline struct blk_dev_struct * blk_queue(int dev)
+{
+	struct blk_dev_struct * bd = MAJOR(dev)+blk_dev;
+
+	return bd->queue ? (bd->queue)(dev) : bd;
+}
+
+/*
+ * A block device has a driver with a request queue, or passes its
+ * buffers on to other devices ('remap', as md does).
+ */
+/// 主设备号是否有驱动
+static inline int blk_exists(unsigned int major)
+{
+	return major < NR_BLK_DEV &&
+		(blk_dev[major].request_fn || blk_dev[major].remap);
+}
+
 ///
 /// 锁缓冲区
 //	如果缓冲区已被所住，则休眠
@@ -76,23 +109,26 @@ static inline void unlock_buffer(struct buffer_head * bh)
 /*
  * add-request adds a request to the linked list.
  * It disables interrupts so that it can muck with the
- * request-lists in peace.
- *
- * Note that swapping requests always go before other requests,
- * and are done in the order they appear.
+ * request-lists in peace. Where the request goes is up
+ * to the I/O scheduler of the device, except for FLUSH
+ * requests: they are barriers, and go last.
  */
 
  /// 向链表中加入一项请求  会关闭中断
  //	如果设备dev中请求项列表为空，则直接执行req请求
- //	否则，把req请求插入到dev的请求列表中
+ //	否则，由设备的I/O调度器把req请求插入到dev的请求列表中
 static void add_request(struct blk_dev_struct * dev, struct request * req)
 {
 	struct request * tmp;
+	struct buffer_head * bh;
 
 	req->next = NULL;
+	req->fifo_next = req->fifo_prev = NULL;
+	req->start = jiffies;
+	req->expires = jiffies + ((req->cmd == READ) ? READ_EXPIRE : WRITE_EXPIRE);
 	cli();
-	if (req->bh)
-		req->bh->b_dirt = 0;	// 缓冲区脏标记 清理
+	for (bh = req->bh ; bh ; bh = bh->b_reqnext)
+		bh->b_dirt = 0;	// 缓冲区脏标记 清理
 	/// 设备请求链表为空，直接执行请求
 	if (!(tmp = dev->current_request)) {
 		dev->current_request = req;	// 赋值到请求列表中
@@ -100,38 +136,194 @@ static void add_request(struct blk_dev_struct * dev, struct request * req)
 		(dev->request_fn)();
 		return;
 	}
-	for ( ; tmp->next ; tmp=tmp->next) {
-		if (!req->bh)  // 请求没有设置缓冲区
-			// 后续请求节点有缓冲区，退出循环
-			if (tmp->next->bh)
+	// 屏障请求总是放在队尾
+	if (req->cmd == FLUSH) {
+		while (tmp->next)
+			tmp = tmp->next;
+		tmp->next = req;
+	} else
+		(dev->sched->add_request)(dev,req);
+	sti();
+}
+
+/// 给请求项池增加一页请求项 调用时须关中断
+static int grow_requests(void)
+{
+	struct request * req;
+	unsigned long page;
+	int i;
+
+	if (request_pages >= MAX_REQUEST_PAGES || !(page = get_free_page()))
+		return 0;
+	request_pages++;
+	req = (struct request *) page;
+	for (i = PAGE_SIZE/sizeof(struct request) ; i > 0 ; i--,req++) {
+		req->dev = -1;
+		req->bh = req->bhtail = NULL;
+		req->fifo_next = req->fifo_prev = NULL;
+		req->next = free_requests;
+		free_requests = req;
+	}
+	return 1;
+}
+
+/*
+ * Find a free request. No device may hold more than its max_requests,
+ * and writes only write_pct percent of those, as set by the I/O
+ * scheduler of the device. If there is none we sleep, unless this is
+ * read-ahead or write-ahead, which isn't worth waiting for.
+ */
+/// 找一个空闲的请求项 没有时睡眠等待，预读/预写则返回NULL
+static struct request * get_request(struct blk_dev_struct * dev,
+	int rw, int rw_ahead)
+{
+	struct request * req;
+	int max = dev->max_requests;
+
+/* we don't allow the write-requests to fill up the queue completely:
+ * we want some room for reads: they take precedence.
+ */
+	if (rw != READ)
+		max = (max * dev->sched->write_pct) / 100;	// 其余的留给读请求
+	cli();
+	while (dev->nr_requests >= max || (!free_requests && !grow_requests())) {
+/* if none found, sleep on new requests: check for rw_ahead */
+		if (rw_ahead) {
+			sti();
+			return NULL;
+		}
+		sleep_on((rw == READ) ? &wait_for_read : &wait_for_write);
+	}
+	req = free_requests;
+	free_requests = req->next;
+	req->next = NULL;
+	dev->nr_requests++;
+	sti();
+	return req;
+}
+
+/*
+ * Give a finished request back to the pool. Waiting readers are always
+ * woken up. Writers are woken when a write finished, no reader is
+ * waiting, or the device is below its write limit again: a writer may
+ * be waiting for just that, while only reads finish on the device.
+ */
+/// 释放请求项 由end_request()调用
+void free_request(struct request * req)
+{
+	struct blk_dev_struct * dev = blk_queue(req->dev);
+
+	cli();
+	dev->nr_requests--;
+	req->dev = -1;
+	req->next = free_requests;
+	free_requests = req;
+	wake_up(&wait_for_read);
+	if (req->cmd == WRITE || !wait_for_read || dev->nr_requests <
+	    (dev->max_requests * dev->sched->write_pct) / 100)
+		wake_up(&wait_for_write);
+	sti();
+}
+
+/*
+ * Try to add the buffers first..last to a request already queued for
+ * the adjacent sectors of the same device, in the same direction:
+ * at its end (back merge) or in front of it (front merge). The first
+ * request of the list is being worked on by the driver and isn't
+ * touched, nor are those ahead of a barrier. Called with interrupts off.
+ */
+/// 尝试把缓冲块合并到已有的请求项中 成功返回1
+static int merge_request(struct blk_dev_struct * dev, int rw,
+	struct buffer_head * first, struct buffer_head * last, int nr)
+{
+	struct request * req, * tmp;
+	struct buffer_head * bh;
+	unsigned long sector = first->b_blocknr<<1;
+
+	if (!(req = dev->current_request))
+		return 0;
+	// 不能合并到屏障请求之前的请求项中
+	for (tmp = req->next ; tmp ; tmp = tmp->next)
+		if (tmp->cmd == FLUSH)
+			req = tmp;
+	while (req = req->next) {
+		if (req->dev != first->b_dev || req->cmd != rw || !req->bh)
+			continue;
+		if (req->nr_sectors + (nr<<1) > MAX_SECTORS)
+			continue;
+		if (req->sector + req->nr_sectors == sector) {
+			req->bhtail->b_reqnext = first;
+			req->bhtail = last;
+		} else if (sector + (nr<<1) == req->sector) {
+			last->b_reqnext = req->bh;
+			req->bh = first;
+			req->buffer = first->b_data;
+			req->sector = sector;
+		} else
+			continue;
+		req->nr_sectors += nr<<1;
+		for (bh = first ; ; bh = bh->b_reqnext) {
+			bh->b_dirt = 0;
+			if (bh == last)
 				break;
-			else
-				continue;
-
-		// 找到插入请求的位置
-		/*
-			判断式等价于
-			(tmp < req || tmp >= tmp->next) && (req < tmp->next)
-			又等价于
-			(tmp < req && req < tmp->next)  ||   // 表示当前的请求顺序是 从小到大 req 刚好可以插入到中间
-			(tmp >= tmp->next && req < tmp->next)  // 表示当前的请求顺序是 从大到小，
-			                                         实际应该插入到tmp->next 但还是插入到tmp后，表示让req当转向节点
-		*/
-		if ((IN_ORDER(tmp,req) || !IN_ORDER(tmp,tmp->next)) &&
-		    IN_ORDER(req,tmp->next))
-			break;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Queue the locked buffers first..last (linked through b_reqnext, 'nr'
+ * contiguous blocks on the same device) as one request. Devices that
+ * remap get them as they are, and always do them, read-ahead or not.
+ */
+/// 把first到last这nr个连续的缓冲块作为一个请求项加入队列
+void submit_buffers(int rw, int rw_ahead,
+	struct buffer_head * first, struct buffer_head * last, int nr)
+{
+	struct blk_dev_struct * dev = blk_queue(first->b_dev);
+	struct request * req;
+	struct buffer_head * bh;
+
+	last->b_reqnext = NULL;
+	if (blk_dev[MAJOR(first->b_dev)].remap) {
+		(blk_dev[MAJOR(first->b_dev)].remap)(rw,first->b_dev,first,last,nr);
+		return;
+	}
+	cli();
+	if (merge_request(dev,rw,first,last,nr)) {
+		sti();
+		return;
 	}
-	// 插入到temp后面
-	req->next=tmp->next;
-	tmp->next=req;
 	sti();
+	if (!(req = get_request(dev,rw,rw_ahead))) {
+		while (bh = first) {
+			first = bh->b_reqnext;
+			bh->b_reqnext = NULL;
+			unlock_buffer(bh);
+		}
+		return;
+	}
+/* fill up the request-info, and add it to the queue */
+	// 填充请求结构
+	req->dev = first->b_dev;
+	req->cmd = rw;
+	req->errors=0;
+	req->sector = first->b_blocknr<<1;		// 起始扇区位置
+	req->nr_sectors = nr<<1;				// 每块2个扇区
+	req->buffer = first->b_data;
+	req->waiting = NULL;
+	req->status = NULL;
+	req->bh = first;
+	req->bhtail = last;
+	req->next = NULL;
+	add_request(dev,req);
 }
 
 // 创建请求
 // 参数：major 主设备号  ; rw 读写命令  ;  bh 缓冲区
 static void make_request(int major,int rw, struct buffer_head * bh)
 {
-	struct request * req;
 	int rw_ahead;
 
 /* WRITEA/READA is special case - it is not really needed, so if the */
@@ -150,49 +342,46 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 		panic("Bad block dev command, must be R/W/RA/WA");
 	// 锁缓冲区
 	lock_buffer(bh);
+	/* a buffer of the ram disk is the ram disk: nothing to do */
+	if (bh->b_mapped)
+		bh->b_dirt = 0;
 	// 写指令，缓冲区没有脏标记  直接解锁
 	// 读指令，缓冲区已经更到最新，直接解锁
 	if ((rw == WRITE && !bh->b_dirt) || (rw == READ && bh->b_uptodate)) {
 		unlock_buffer(bh);
 		return;
 	}
-repeat:
-/* we don't allow the write-requests to fill up the queue completely:
- * we want some room for reads: they take precedence. The last third
- * of the requests are only for reads.
+	submit_buffers(rw,rw_ahead,bh,bh,1);
+}
+
+/*
+ * Paging to a device that remaps: the page goes as the buffers of its
+ * blocks, made up on the stack, as they are not in the buffer cache.
  */
-	if (rw == READ)
-		req = request+NR_REQUEST;	// 队尾
-	else
-		req = request+((NR_REQUEST*2)/3);	// 后三分一是读请求
-/* find an empty request */
-	// 往前找到一个空闲的请求项
-	while (--req >= request)
-		if (req->dev<0)
-			break;
-/* if none found, sleep on new requests: check for rw_ahead */
-	/// 如果没找到，先判断预读 有预读就解锁缓冲区返回
-	//	否则，就睡眠等待请求结构的释放
-	if (req < request) {
-		if (rw_ahead) {
-			unlock_buffer(bh);
-			return;
-		}
-		sleep_on(&wait_for_request);
-		goto repeat;
+/// 通过remap读写一页 等待完成
+static void remap_page(int rw, int dev, int page, char * buffer)
+{
+	struct buffer_head bh[PAGE_SIZE/BLOCK_SIZE];
+	int i;
+
+	for (i = 0 ; i < PAGE_SIZE/BLOCK_SIZE ; i++) {
+		bh[i].b_data = buffer + i*BLOCK_SIZE;
+		bh[i].b_blocknr = page*(PAGE_SIZE/BLOCK_SIZE) + i;
+		bh[i].b_dev = dev;
+		bh[i].b_uptodate = 0;
+		bh[i].b_dirt = (rw == WRITE);
+		bh[i].b_lock = 1;
+		bh[i].b_wait = NULL;
+		bh[i].b_end_io = NULL;
+		bh[i].b_reqnext = bh+i+1;
 	}
-/* fill up the request-info, and add it to the queue */
-	// 填充请求结构
-	req->dev = bh->b_dev;
-	req->cmd = rw;
-	req->errors=0;
-	req->sector = bh->b_blocknr<<1;		// 起始扇区位置
-	req->nr_sectors = 2;				// 第一个块，2个扇区
-	req->buffer = bh->b_data;
-	req->waiting = NULL;
-	req->bh = bh;
-	req->next = NULL;
-	add_request(major+blk_dev,req);
+	bh[i-1].b_reqnext = NULL;
+	(blk_dev[MAJOR(dev)].remap)(rw,dev,bh,bh+i-1,i);
+	cli();
+	for (i = 0 ; i < PAGE_SIZE/BLOCK_SIZE ; i++)
+		while (bh[i].b_lock)
+			sleep_on(&bh[i].b_wait);
+	sti();
 }
 
 /// low level read-write page 低级页面读写
@@ -207,22 +396,19 @@ void ll_rw_page(int rw, 		// 读写命令
 	unsigned int major = MAJOR(dev);
 
 	// 设备号不对 相关检测
-	if (major >= NR_BLK_DEV || !(blk_dev[major].request_fn)) {
+	if (!blk_exists(major)) {
 		printk("Trying to read nonexistent block-device\n\r");
 		return;
 	}
 	// 读写指令检测
 	if (rw!=READ && rw!=WRITE)
 		panic("Bad block dev command, must be R/W");
-repeat:
-	req = request+NR_REQUEST;
-	while (--req >= request)
-		if (req->dev<0)
-			break;
-	if (req < request) {
-		sleep_on(&wait_for_request);
-		goto repeat;
+	if (blk_dev[major].remap) {
+		remap_page(rw,dev,page,buffer);
+		return;
 	}
+/* paging may use all the requests of the device, like reads */
+	req = get_request(blk_queue(dev),READ,0);
 /* fill up the request-info, and add it to the queue */
 	req->dev = dev;
 	req->cmd = rw;
@@ -231,35 +417,176 @@ repeat:
 	req->nr_sectors = 8;
 	req->buffer = buffer;
 	req->waiting = current;
+	req->status = NULL;
 	req->bh = NULL;
+	req->bhtail = NULL;
 	req->next = NULL;
 	// 因为要读8个扇区，花费时间长，睡眠当前进程
 	current->state = TASK_UNINTERRUPTIBLE;
-	add_request(major+blk_dev,req);
+	add_request(blk_queue(dev),req);
 	schedule();
 }	
 
+/*
+ * Have the device put everything it was given so far on the medium, and
+ * wait for it. The FLUSH request is a barrier: no request queued after
+ * it is done before it, nor the other way round. Returns 0, or -EIO if
+ * the device couldn't do it.
+ */
+/// 刷新设备的写缓存 并等待完成
+int ll_rw_flush(int dev)
+{
+	struct request * req;
+	unsigned int major = MAJOR(dev);
+	int status = 0;
+
+	if (!blk_exists(major)) {
+		printk("Trying to flush nonexistent block-device\n\r");
+		return -EIO;
+	}
+	if (blk_dev[major].remap)
+		return (blk_dev[major].remap)(FLUSH,dev,NULL,NULL,0);
+	req = get_request(blk_queue(dev),WRITE,0);
+	req->dev = dev;
+	req->cmd = FLUSH;
+	req->errors = 0;
+	req->sector = 0;
+	req->nr_sectors = 0;
+	req->buffer = NULL;
+	req->waiting = current;
+	req->status = &status;
+	req->bh = NULL;
+	req->bhtail = NULL;
+	req->next = NULL;
+	current->state = TASK_UNINTERRUPTIBLE;
+	add_request(blk_queue(dev),req);
+	schedule();
+	return status ? 0 : -EIO;
+}
+
 /// 低级读写块
 //	进程可能会在其中睡眠
 void ll_rw_block(int rw, struct buffer_head * bh)
 {
 	unsigned int major;
 
-	if ((major=MAJOR(bh->b_dev)) >= NR_BLK_DEV ||
-	!(blk_dev[major].request_fn)) {
+	if (!blk_exists(major=MAJOR(bh->b_dev))) {
 		printk("Trying to read nonexistent block-device\n\r");
 		return;
 	}
 	make_request(major,rw,bh);
 }
 
+/*
+ * ll_rw_cluster() is ll_rw_block() for an array of buffers. Buffers that
+ * don't need any I/O (or that are NULL) split the array into runs, and
+ * each run of up to MAX_CLUSTER contiguous blocks on the same device
+ * goes to the driver as one multi-sector request. The run is sent off
+ * before waiting for a locked buffer: the array need not be in block
+ * order, and another task may be waiting for a buffer of the run while
+ * holding the one we wait for.
+ */
+/// 低级读写多个缓冲块 连续的块合并成一个请求项
+void ll_rw_cluster(int rw, int nr, struct buffer_head * bh[])
+{
+	struct buffer_head * first = NULL, * last = NULL, * tmp;
+	unsigned int major = 0;
+	int rw_ahead, i, n = 0;
+
+	if (rw_ahead = (rw == READA || rw == WRITEA))
+		rw = (rw == READA) ? READ : WRITE;
+	if (rw!=READ && rw!=WRITE)
+		panic("Bad block dev command, must be R/W/RA/WA");
+	for (i=0 ; i<nr ; i++) {
+		if (!(tmp = bh[i]))
+			goto next_run;
+		if (!blk_exists(major=MAJOR(tmp->b_dev))) {
+			printk("Trying to read nonexistent block-device\n\r");
+			goto next_run;
+		}
+		if (rw_ahead && tmp->b_lock)
+			goto next_run;
+		// 不能拿着还没交出去的加锁缓冲块睡眠 别的进程可能正等着它们
+		if (tmp->b_lock && first) {
+			submit_buffers(rw,rw_ahead,first,last,n);
+			first = NULL;
+		}
+		lock_buffer(tmp);
+		if (tmp->b_mapped)
+			tmp->b_dirt = 0;
+		if ((rw == WRITE && !tmp->b_dirt) ||
+		    (rw == READ && tmp->b_uptodate)) {
+			unlock_buffer(tmp);
+			goto next_run;
+		}
+		if (first && (n >= MAX_CLUSTER || tmp->b_dev != first->b_dev ||
+		    tmp->b_blocknr != last->b_blocknr+1)) {
+			submit_buffers(rw,rw_ahead,first,last,n);
+			first = NULL;
+		}
+		if (!first) {
+			first = tmp;
+			n = 0;
+		} else
+			last->b_reqnext = tmp;
+		last = tmp;
+		n++;
+		continue;
+next_run:
+		if (first)
+			submit_buffers(rw,rw_ahead,first,last,n);
+		first = NULL;
+	}
+	if (first)
+		submit_buffers(rw,rw_ahead,first,last,n);
+}
+
 /// 块设备初始化
 void blk_dev_init(void)
 {
 	int i;
 
-	for (i=0 ; i<NR_REQUEST ; i++) {
-		request[i].dev = -1;
-		request[i].next = NULL;
+	for (i=0 ; i<NR_BLK_DEV ; i++) {
+		blk_dev[i].nr_requests = 0;
+		blk_dev[i].max_requests = NR_REQUEST;
+		set_iosched(blk_dev+i,DEF_IOSCHED);
+	}
+}
+
+/*
+ * Block device ioctls. BLKGETSCHED returns the I/O scheduler of the
+ * device (one of IOSCHED_xxx), BLKSETSCHED sets it. The scheduler is
+ * per request queue, so it may be shared by all minors. BLKGETWAIT copies the longest
+ * time (in ticks) a read and a write request have waited in the queue
+ * to the two longs at arg, and starts measuring anew.
+ */
+/// 块设备ioctl 查询/设置设备的I/O调度器
+int blk_ioctl(int dev, int cmd, int arg)
+{
+	struct blk_dev_struct * bd;
+
+	if (MAJOR(dev) >= NR_BLK_DEV || !blk_dev[MAJOR(dev)].request_fn)
+		return -ENODEV;
+	bd = blk_queue(dev);
+	switch (cmd) {
+		case BLKGETSCHED:
+			return bd->sched - iosched;
+		case BLKSETSCHED:
+			if (!suser())
+				return -EPERM;
+			if (arg < 0 || arg >= NR_IOSCHED)
+				return -EINVAL;
+			set_iosched(bd,arg);
+			return 0;
+		case BLKGETWAIT:
+			verify_area((void *) arg,2*sizeof(long));
+			cli();
+			put_fs_long(bd->max_wait[READ],(unsigned long *) arg);
+			put_fs_long(bd->max_wait[WRITE],1+(unsigned long *) arg);
+			bd->max_wait[READ] = bd->max_wait[WRITE] = 0;
+			sti();
+			return 0;
+		default:
+			return -EINVAL;
 	}
 }
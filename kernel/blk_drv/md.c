@@ -0,0 +1,348 @@
+/*
+ *  linux/kernel/blk_drv/md.c
+ */
+
+/*
+ * md ("multiple devices") makes one block device out of several others,
+ * normally partitions on different disks:
+ *
+ *	RAID-0 - the blocks are striped over the disks, 'chunk' blocks to
+ *		 a disk in turn, so that long transfers keep them all busy.
+ *	RAID-1 - every disk holds all the data. Writes go to all of them,
+ *		 a read goes to the disk whose head is nearest.
+ *
+ * md has no request queue: ll_rw_blk hands it the buffers as they are
+ * submitted, and it passes them on to the disks as shadow buffers. A
+ * shadow shares the data of the real buffer, but has the device and the
+ * block number on the disk, so the disks queue, sort and merge shadows
+ * like any other buffers. When the last shadow of a buffer is done, the
+ * buffer is unlocked.
+ */
+#include <errno.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+#include <asm/segment.h>
+
+#include "blk.h"
+
+#define NR_MD			2	// md设备数
+#define MAX_SHADOW_PAGES	4	// 影子缓冲块最多占用的页数
+
+struct md_struct {
+	int level;							// MD_RAID0/MD_RAID1
+	int chunk;							// RAID-0: 每个硬盘上连续的块数
+	int nr_disks;						// 0表示没有设置
+	int disks[MD_MAX_DISKS];			// 组成设备的设备号
+	unsigned long head[MD_MAX_DISKS];	// 各硬盘最后请求到的块 大致是磁头位置
+};
+
+static struct md_struct md_dev[NR_MD];
+static int md_sizes[NR_MD] = {0, };
+
+/*
+ * Free shadows are kept on a list through b_next_free. The shadows of
+ * one buffer (one per disk for a RAID-1 write, else just one) are on a
+ * ring through b_next: shadows are never hashed.
+ */
+static struct buffer_head * free_shadows = NULL;
+static int shadow_pages = 0;
+static struct task_struct * wait_for_shadow = NULL;
+
+/*
+ * The shadows on their way to one disk: contiguous blocks, sent as one
+ * request once the next shadow doesn't fit.
+ */
+struct md_run {
+	struct buffer_head * first, * last;
+	int nr;
+};
+
+/// 给影子缓冲块池增加一页 调用时须关中断
+static int grow_shadows(void)
+{
+	struct buffer_head * sh;
+	unsigned long page;
+	int i;
+
+	if (shadow_pages >= MAX_SHADOW_PAGES || !(page = get_free_page()))
+		return 0;
+	shadow_pages++;
+	sh = (struct buffer_head *) page;
+	for (i = PAGE_SIZE/sizeof(struct buffer_head) ; i > 0 ; i--,sh++) {
+		sh->b_next_free = free_shadows;
+		free_shadows = sh;
+	}
+	return 1;
+}
+
+/// 把run中的影子缓冲块作为一个请求交给硬盘
+static void submit_run(int rw, struct md_run * run)
+{
+	if (run->first)
+		submit_buffers(rw,0,run->first,run->last,run->nr);
+	run->first = NULL;
+	run->nr = 0;
+}
+
+/*
+ * Get a free shadow. Before going to sleep for one, the shadows we hold
+ * are sent off: it is their getting done that frees shadows.
+ */
+/// 取一个空闲的影子缓冲块
+static struct buffer_head * get_shadow(int rw, struct md_run * run, int nr)
+{
+	struct buffer_head * sh;
+	int i;
+
+	cli();
+	while (!free_shadows && !grow_shadows()) {
+		sti();
+		for (i = 0 ; i < nr ; i++)
+			submit_run(rw,run+i);
+		cli();
+		if (!free_shadows)
+			sleep_on(&wait_for_shadow);
+	}
+	sh = free_shadows;
+	free_shadows = sh->b_next_free;
+	sti();
+	return sh;
+}
+
+/// 释放影子缓冲块
+static void free_shadow(struct buffer_head * sh)
+{
+	cli();
+	sh->b_next_free = free_shadows;
+	free_shadows = sh;
+	wake_up(&wait_for_shadow);
+	sti();
+}
+
+/// 结束一个真正的缓冲块
+static void md_end_buffer(struct buffer_head * bh, int uptodate)
+{
+	bh->b_uptodate = uptodate;
+	bh->b_lock = 0;
+	wake_up(&bh->b_wait);
+}
+
+/*
+ * Called from end_request() when a disk is done with a shadow. Once all
+ * the shadows of the buffer are, the buffer is done: for a RAID-1 write
+ * it is good if one disk has it.
+ */
+/// 影子缓冲块的I/O完成函数
+static void md_end_io(struct buffer_head * sh, int uptodate)
+{
+	struct buffer_head * bh = sh->b_private;
+	struct buffer_head * tmp, * next;
+
+	sh->b_uptodate = uptodate;
+	sh->b_lock = 0;
+	for (tmp = sh->b_next ; tmp != sh ; tmp = tmp->b_next)
+		if (tmp->b_lock)
+			return;
+	uptodate = 0;
+	tmp = sh;
+	do {
+		uptodate |= tmp->b_uptodate;
+		next = tmp->b_next;
+		free_shadow(tmp);
+	} while ((tmp = next) != sh);
+	md_end_buffer(bh,uptodate);
+}
+
+/// RAID-1: 磁头离block最近的硬盘
+static int md_nearest(struct md_struct * md, unsigned long block)
+{
+	unsigned long dist, min = 0xffffffff;
+	int i, disk = 0;
+
+	for (i = 0 ; i < md->nr_disks ; i++) {
+		dist = (block > md->head[i]) ? block - md->head[i] :
+			md->head[i] - block;
+		if (dist < min) {
+			min = dist;
+			disk = i;
+		}
+	}
+	return disk;
+}
+
+/// 把影子缓冲块加到去往它硬盘的run中 接不上就先交出run
+static void add_shadow(int rw, struct md_run * run, struct buffer_head * sh)
+{
+	if (run->first && (run->nr >= MAX_CLUSTER ||
+	    sh->b_blocknr != run->last->b_blocknr+1))
+		submit_run(rw,run);
+	if (run->first)
+		run->last->b_reqnext = sh;
+	else
+		run->first = sh;
+	run->last = sh;
+	run->nr++;
+}
+
+/*
+ * The remap function of md: called by ll_rw_blk with the locked buffers
+ * first..last, 'nr' contiguous blocks of an md device, or with FLUSH to
+ * have everything on the disks. May sleep. Returns -EIO if a disk
+ * failed the FLUSH, else 0.
+ */
+/// md的转发函数 把缓冲块转成各硬盘上的影子缓冲块
+static int md_remap(int rw, int dev, struct buffer_head * first,
+	struct buffer_head * last, int nr)
+{
+	struct md_struct * md = md_dev + MINOR(dev);
+	struct md_run run[MD_MAX_DISKS];
+	struct buffer_head * bh, * next, * sh, * ring[MD_MAX_DISKS];
+	unsigned long block, chunk;
+	int i, disk, copies, err = 0;
+
+	if (MINOR(dev) >= NR_MD || !md->nr_disks) {
+		for (bh = first ; bh ; bh = next) {
+			next = bh->b_reqnext;
+			bh->b_reqnext = NULL;
+			md_end_buffer(bh,0);
+		}
+		return -EIO;
+	}
+	if (rw == FLUSH) {
+		for (i = 0 ; i < md->nr_disks ; i++)
+			if (ll_rw_flush(md->disks[i]))
+				err = -EIO;
+		return err;
+	}
+	for (i = 0 ; i < md->nr_disks ; i++) {
+		run[i].first = NULL;
+		run[i].nr = 0;
+	}
+	for (bh = first ; bh ; bh = next) {
+		next = bh->b_reqnext;
+		bh->b_reqnext = NULL;
+		bh->b_dirt = 0;
+		block = bh->b_blocknr;
+		if (block >= md_sizes[MINOR(dev)]) {
+			md_end_buffer(bh,0);
+			continue;
+		}
+		copies = 1;
+		if (md->level == MD_RAID0) {
+			chunk = block / md->chunk;
+			disk = chunk % md->nr_disks;
+			block = (chunk / md->nr_disks) * md->chunk +
+				block % md->chunk;
+			md->head[disk] = block+1;
+		} else if (rw == READ) {
+			disk = md_nearest(md,block);
+			md->head[disk] = block+1;
+		} else {
+			disk = 0;
+			copies = md->nr_disks;
+			for (i = 0 ; i < copies ; i++)
+				md->head[i] = block+1;
+		}
+		// 先做好这块的所有影子 连成环 然后才能交出去
+		for (i = 0 ; i < copies ; i++) {
+			sh = ring[i] = get_shadow(rw,run,md->nr_disks);
+			sh->b_data = bh->b_data;
+			sh->b_blocknr = block;
+			sh->b_dev = md->disks[disk+i];
+			sh->b_uptodate = 0;
+			sh->b_dirt = 0;
+			sh->b_count = 0;
+			sh->b_lock = 1;
+			sh->b_wait = NULL;
+			sh->b_prev = NULL;
+			sh->b_next = ring[0];
+			if (i)
+				ring[i-1]->b_next = sh;
+			sh->b_reqnext = NULL;
+			sh->b_end_io = md_end_io;
+			sh->b_private = bh;
+		}
+		for (i = 0 ; i < copies ; i++)
+			add_shadow(rw,run+disk+i,ring[i]);
+	}
+	for (i = 0 ; i < md->nr_disks ; i++)
+		submit_run(rw,run+i);
+	return 0;
+}
+
+/*
+ * MDSETUP makes an md device out of the disks in the struct md_setup at
+ * arg, unless it has been set up already. The disks must be devices of
+ * known size, with a request queue. MDSTOP undoes it, if the device isn't
+ * mounted.
+ */
+/// md设备的ioctl
+int md_ioctl(int dev, int cmd, int arg)
+{
+	struct md_struct * md;
+	struct md_setup setup;
+	int i, d, size, n;
+
+	if (MINOR(dev) >= NR_MD)
+		return -ENODEV;
+	md = md_dev + MINOR(dev);
+	switch (cmd) {
+		case MDSETUP:
+			if (!suser())
+				return -EPERM;
+			if (md->nr_disks)
+				return -EBUSY;
+			for (i = 0 ; i < sizeof(setup)/sizeof(long) ; i++)
+				((long *) &setup)[i] = get_fs_long(i+(unsigned long *) arg);
+			if ((setup.level != MD_RAID0 && setup.level != MD_RAID1) ||
+			    setup.nr_disks < 1 || setup.nr_disks > MD_MAX_DISKS ||
+			    (setup.level == MD_RAID0 && setup.chunk < 1))
+				return -EINVAL;
+			size = 0;
+			for (i = 0 ; i < setup.nr_disks ; i++) {
+				d = setup.disks[i];
+				if (MAJOR(d) >= NR_BLK_DEV ||
+				    !blk_dev[MAJOR(d)].request_fn ||
+				    !blk_size[MAJOR(d)] ||
+				    !(n = blk_size[MAJOR(d)][MINOR(d)]))
+					return -ENXIO;
+				if (!i || n < size)
+					size = n;
+			}
+			if (setup.level == MD_RAID0)
+				size = (size / setup.chunk) * setup.chunk * setup.nr_disks;
+			md->level = setup.level;
+			md->chunk = setup.chunk;
+			for (i = 0 ; i < setup.nr_disks ; i++) {
+				md->disks[i] = setup.disks[i];
+				md->head[i] = 0;
+			}
+			md->nr_disks = setup.nr_disks;
+			md_sizes[md-md_dev] = size;
+			printk("md%d: RAID-%d, %d disks, %d blocks\n\r",md-md_dev,
+				md->level,md->nr_disks,size);
+			return 0;
+		case MDSTOP:
+			if (!suser())
+				return -EPERM;
+			if (!md->nr_disks)
+				return -EINVAL;
+			if (get_super(dev))
+				return -EBUSY;
+			sync_dev(dev);
+			invalidate_buffers(dev);
+			md->nr_disks = 0;
+			md_sizes[md-md_dev] = 0;
+			return 0;
+		default:
+			return -EINVAL;
+	}
+}
+
+/// md初始化
+void md_init(void)
+{
+	blk_dev[MD_MAJOR].remap = md_remap;
+	blk_size[MD_MAJOR] = md_sizes;
+}
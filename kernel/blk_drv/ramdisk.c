@@ -26,12 +26,20 @@ void do_rd_request(void)
 	char	*addr;
 
 	INIT_REQUEST;
+	/* nothing to flush: the data is in memory already */
+	if (CURRENT->cmd == FLUSH) {
+		end_request(1);
+		goto repeat;
+	}
 	addr = rd_start + (CURRENT->sector << 9);
 	len = CURRENT->nr_sectors << 9;
 	if ((MINOR(CURRENT->dev) != 1) || (addr+len > rd_start+rd_length)) {
 		end_request(0);
 		goto repeat;
 	}
+	/* one buffer at a time: they needn't be contiguous in memory */
+	if (CURRENT->bh)
+		len = BLOCK_SIZE;
 	if (CURRENT-> cmd == WRITE) {
 		(void ) memcpy(addr,
 			      CURRENT->buffer,
@@ -46,6 +54,18 @@ void do_rd_request(void)
 	goto repeat;
 }
 
+/*
+ * Where the data of block 'block' of the ram disk is, for the buffer
+ * cache to use as the buffer itself: then reading and writing the block
+ * takes no request and no copy. NULL if there is no such block.
+ */
+char * rd_map(int dev, int block)
+{
+	if (dev != 0x0101 || block < 0 || block >= (rd_length >> BLOCK_SIZE_BITS))
+		return NULL;
+	return rd_start + (block << BLOCK_SIZE_BITS);
+}
+
 /*
  * Returns amount of memory which needs to be reserved.
  */
@@ -63,6 +83,97 @@ long rd_init(long mem_start, int length)
 	return(length);
 }
 
+/*
+ * The ram disk image on the floppy may also be compressed, so that far
+ * fewer blocks have to be read at boot. Block 256 then starts with a
+ * struct rd_lz_header, and the compressed data follows from block 257
+ * (tools/rdlz makes such an image). The data is LZSS: a flag byte tells
+ * what the next eight items are, low bit first - 1 for a literal byte,
+ * 0 for a match. A match is two bytes c,d: copy (d & 0x0f)+3 bytes from
+ * (c | (d & 0xf0) << 4)+1 bytes back. The ram disk itself is the window,
+ * so the data is decompressed straight into it as the blocks come in.
+ */
+#define RD_LZ_MAGIC	0x5a4c4452	/* "RDLZ" */
+
+struct rd_lz_header {
+	unsigned long magic;
+	unsigned long size;		/* bytes, uncompressed */
+	unsigned long csize;		/* bytes, compressed */
+};
+
+static struct buffer_head * lz_bh;	// 当前读到的压缩数据块
+static int lz_block, lz_pos, lz_left;	// 其块号 块内位置 剩余压缩字节数
+
+/// 取压缩数据的下一个字节 出错或没有了返回-1
+static int lz_byte(void)
+{
+	if (lz_left <= 0)
+		return -1;
+	if (lz_pos >= BLOCK_SIZE) {
+		brelse(lz_bh);
+		if (lz_left > 2*BLOCK_SIZE)
+			lz_bh = breada(ROOT_DEV,lz_block,lz_block+1,lz_block+2,-1);
+		else
+			lz_bh = bread(ROOT_DEV,lz_block);
+		if (!lz_bh) {
+			printk("I/O error on block %d, aborting load\n",
+				lz_block);
+			lz_left = 0;
+			return -1;
+		}
+		printk("\010\010\010\010\010%4dk",lz_block-256);
+		lz_block++;
+		lz_pos = 0;
+	}
+	lz_left--;
+	return (unsigned char) lz_bh->b_data[lz_pos++];
+}
+
+/// 把压缩的映像解压到内存虚拟盘中 成功返回1
+static int rd_load_lz(struct rd_lz_header * h)
+{
+	char * out = rd_start, * end = rd_start + h->size, * from;
+	unsigned int flags = 0;
+	int c, d, n;
+
+	lz_bh = NULL;
+	lz_block = 257;
+	lz_pos = BLOCK_SIZE;
+	lz_left = h->csize;
+	printk("Loading %d bytes (%d compressed) into ram disk... 0000k",
+		h->size, h->csize);
+	while (out < end) {
+		// 高8位用来计数 8项用完就读新的标志字节
+		if (!((flags >>= 1) & 0x100)) {
+			if ((c = lz_byte()) < 0)
+				break;
+			flags = c | 0xff00;
+		}
+		if ((c = lz_byte()) < 0)
+			break;
+		if (flags & 1) {
+			*out++ = c;
+			continue;
+		}
+		if ((d = lz_byte()) < 0)
+			break;
+		from = out - (c | ((d & 0xf0) << 4)) - 1;
+		n = (d & 0x0f) + 3;
+		if (from < rd_start || out + n > end)
+			break;
+		while (n--)
+			*out++ = *from++;
+	}
+	brelse(lz_bh);
+	if (out != end || ((struct d_super_block *)
+	    (rd_start + BLOCK_SIZE))->s_magic != SUPER_MAGIC) {
+		printk("\nBad compressed ram disk image, aborting load\n");
+		return 0;
+	}
+	printk("\010\010\010\010\010done \n");
+	return 1;
+}
+
 /*
  * If the root device is the ram disk, try to load it.
  * In order to do this, the root device is originally set to the
@@ -72,6 +183,7 @@ void rd_load(void)
 {
 	struct buffer_head *bh;
 	struct super_block	s;
+	struct rd_lz_header	h;
 	int		block = 256;	/* Start at block 256 */
 	int		i = 1;
 	int		nblocks;
@@ -83,11 +195,33 @@ void rd_load(void)
 		(int) rd_start);
 	if (MAJOR(ROOT_DEV) != 2)
 		return;
-	bh = breada(ROOT_DEV,block+1,block,block+2,-1);
+	/*
+	 * A compressed image has its header in block 256, an uncompressed
+	 * one its (unused) boot block: look for the header first, the
+	 * compressed data in block 257 could look like a super-block.
+	 */
+	bh = breada(ROOT_DEV,block,block+1,block+2,-1);
 	if (!bh) {
 		printk("Disk error while looking for ramdisk!\n");
 		return;
 	}
+	h = *((struct rd_lz_header *) bh->b_data);
+	brelse(bh);
+	if (h.magic == RD_LZ_MAGIC) {
+		if (h.size > rd_length) {
+			printk("Ram disk image too big!  (%d bytes, %d avail)\n",
+				h.size, rd_length);
+			return;
+		}
+		if (rd_load_lz(&h))
+			ROOT_DEV=0x0101;
+		return;
+	}
+	/* block 257 came in with the read-ahead above */
+	if (!(bh = bread(ROOT_DEV,block+1))) {
+		printk("Disk error while looking for ramdisk!\n");
+		return;
+	}
 	*((struct d_super_block *) &s) = *((struct d_super_block *) bh->b_data);
 	brelse(bh);
 	if (s.s_magic != SUPER_MAGIC)
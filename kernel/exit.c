@@ -152,7 +152,7 @@ static inline int send_sig(long sig,struct task_struct * p,int priv)
 	if ((sig == SIGKILL) || (sig == SIGCONT)) {
 		//  这个从stop改为running 为啥？
 		if (p->state == TASK_STOPPED)
-			p->state = TASK_RUNNING;
+			wake_up_process(p);
 		p->exit_code = 0;
 		// 去除掉信号 SIGSTOP  SIGTSTP SIGTTIN SIGTTOU  @doubt
 		p->signal &= ~( (1<<(SIGSTOP-1)) | (1<<(SIGTSTP-1)) |
@@ -168,6 +168,7 @@ static inline int send_sig(long sig,struct task_struct * p,int priv)
 	/* Actually deliver the signal */
 	// 加上信号
 	p->signal |= (1<<(sig-1));
+	signal_wake_up(p);
 	return 0;
 }
 
@@ -286,6 +287,10 @@ volatile void do_exit(long code)
 	struct task_struct *p;
 	int i;
 
+	// 任务结构所在的页面会被释放 定时器不能再挂在时间轮上
+	stop_timer(&current->timeout_timer);
+	stop_timer(&current->alarm_timer);
+	current->timeout = current->alarm = 0;
 	// 释放ldf相关
 	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
 	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
@@ -324,6 +329,7 @@ volatile void do_exit(long code)
 	/* Let father know we died */
 	// 给父进程添加子进程退出信号
 	current->p_pptr->signal |= (1<<(SIGCHLD-1));
+	signal_wake_up(current->p_pptr);
 	
 	/*
 	 * This loop does two things:
@@ -337,8 +343,10 @@ volatile void do_exit(long code)
 		while (1) {
 			// init进程继承当前退出进程的僵死子进程
 			p->p_pptr = task[1];
-			if (p->state == TASK_ZOMBIE)
+			if (p->state == TASK_ZOMBIE) {
 				task[1]->signal |= (1<<(SIGCHLD-1));
+				signal_wake_up(task[1]);
+			}
 			/*
 			 * process group orphan check
 			 * Case ii: Our child is in a different pgrp 
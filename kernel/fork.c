@@ -82,6 +82,9 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	p->state = TASK_UNINTERRUPTIBLE;
 	p->pid = last_pid;
 	p->counter = p->priority;
+	p->nr = nr;
+	p->next_run = p->prev_run = NULL;	/* run_epoch is current's */
+	p->timeout_timer.next = p->alarm_timer.next = NULL;
 	p->signal = 0;
 	p->alarm = 0;
 	p->leader = 0;		/* process leadership doesn't inherit */
@@ -144,7 +147,7 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	if (p->p_osptr)
 		p->p_osptr->p_ysptr = p;
 	current->p_cptr = p;
-	p->state = TASK_RUNNING;	/* do this last, just in case */
+	wake_up_process(p);	/* do this last, just in case */
 	return last_pid;
 }
 
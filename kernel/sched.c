@@ -121,12 +121,183 @@ void math_state_restore()
 	}
 }
 
+/*
+ * The run queue: runnable tasks other than task 0 are on one of
+ * NR_RUNQ circular lists, by their counter (the last list takes all
+ * the larger ones), and run_bitmap has a bit for every list that isn't
+ * empty. The task that is running is taken off: schedule() puts it back
+ * if it still can run. So only tasks that are off the queue have their
+ * counters changed (by do_timer()).
+ *
+ * When all runnable tasks have used up their counters, every counter is
+ * recomputed as counter/2 + priority. Only the runnable tasks are done
+ * at once: sched_epoch counts the recomputes, and a sleeping task
+ * catches up with the ones it missed when it is woken.
+ */
+#define NR_RUNQ	32
+
+static struct task_struct * run_queue[NR_RUNQ];
+static unsigned long run_bitmap = 0;
+static unsigned long sched_epoch = 0;
+
+#define save_flags(x) __asm__("pushfl ; popl %0":"=r" (x))
+#define restore_flags(x) __asm__("pushl %0 ; popfl"::"r" (x))
+
+/// 任务所在就绪队列的下标
+static inline int run_prio(struct task_struct * p)
+{
+	return (p->counter < NR_RUNQ) ? p->counter : NR_RUNQ-1;
+}
+
+/// 把p加到它的就绪队列末尾 调用时须关中断
+static void enqueue_task(struct task_struct * p)
+{
+	struct task_struct ** q = run_queue + run_prio(p);
+
+	if (!*q) {
+		*q = p->next_run = p->prev_run = p;
+		run_bitmap |= 1 << (q - run_queue);
+		return;
+	}
+	p->next_run = *q;
+	p->prev_run = (*q)->prev_run;
+	(*q)->prev_run->next_run = p;
+	(*q)->prev_run = p;
+}
+
+/// 把p从就绪队列中取下 调用时须关中断
+static void dequeue_task(struct task_struct * p)
+{
+	struct task_struct ** q = run_queue + run_prio(p);
+
+	if (p->next_run == p) {
+		*q = NULL;
+		run_bitmap &= ~(1 << (q - run_queue));
+	} else {
+		p->next_run->prev_run = p->prev_run;
+		p->prev_run->next_run = p->next_run;
+		if (*q == p)
+			*q = p->next_run;
+	}
+	p->next_run = p->prev_run = NULL;
+}
+
+/// 补上p错过的counter重算 最多做到counter不再变化为止
+static void update_counter(struct task_struct * p)
+{
+	long c;
+
+	while (p->run_epoch != sched_epoch) {
+		p->run_epoch++;
+		c = (p->counter >> 1) + p->priority;
+		if (c == p->counter) {
+			p->run_epoch = sched_epoch;
+			break;
+		}
+		p->counter = c;
+	}
+}
+
+/*
+ * All runnable tasks have counter 0, so they are all on run_queue[0]:
+ * recompute their counters and move them to their new lists.
+ */
+static void recompute_counters(void)
+{
+	struct task_struct * p, * next;
+
+	sched_epoch++;
+	p = run_queue[0];
+	run_queue[0] = NULL;
+	run_bitmap &= ~1;
+	p->prev_run->next_run = NULL;
+	for ( ; p ; p = next) {
+		next = p->next_run;
+		p->counter = p->priority;
+		p->run_epoch = sched_epoch;
+		enqueue_task(p);
+	}
+}
+
+/*
+ * Make p runnable, and put it on the run queue unless it is there, or
+ * is the task that is running: schedule() will see to that one.
+ */
+/// 使任务就绪 并加入就绪队列
+void wake_up_process(struct task_struct * p)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	p->state = TASK_RUNNING;
+	if (p != current && !p->next_run && p != task[0]) {
+		update_counter(p);
+		enqueue_task(p);
+	}
+	restore_flags(flags);
+}
+
+/*
+ * Called after posting a signal to p: if it isn't blocked, and p is in
+ * an interruptible sleep, p is woken.
+ */
+/// 任务收到信号后 若在可中断睡眠中就唤醒它
+void signal_wake_up(struct task_struct * p)
+{
+	if ((p->signal & ~(_BLOCKABLE & p->blocked)) &&
+	    p->state == TASK_INTERRUPTIBLE)
+		wake_up_process(p);
+}
+
+/*
+ * The timers of a task. A timeout is only waited for in an interruptible
+ * sleep, so schedule() starts the timer when the task goes to sleep.
+ * Should the time have been changed since, the timer is started again
+ * for the new one.
+ */
+/// 任务的timeout到了 在可中断睡眠中就唤醒它
+static void task_timeout(unsigned long data)
+{
+	struct task_struct * p = (struct task_struct *) data;
+
+	if (!p->timeout)
+		return;
+	if (p->timeout >= jiffies) {
+		start_timer(&p->timeout_timer,p->timeout - jiffies + 1);
+		return;
+	}
+	p->timeout = 0;
+	if (p->state == TASK_INTERRUPTIBLE)
+		wake_up_process(p);
+}
+
+/// 任务的alarm到了 发SIGALRM信号
+static void task_alarm(unsigned long data)
+{
+	struct task_struct * p = (struct task_struct *) data;
+
+	if (!p->alarm)
+		return;
+	if (p->alarm >= jiffies) {
+		start_timer(&p->alarm_timer,p->alarm - jiffies + 1);
+		return;
+	}
+	p->signal |= (1<<(SIGALRM-1));
+	p->alarm = 0;
+	signal_wake_up(p);
+}
+
 /*
  *  'schedule()' is the scheduler function. This is GOOD CODE! There
  * probably won't be any reason to change this, as it should work well
  * in all circumstances (ie gives IO-bound processes good response etc).
  * The one thing you might take a look at is the signal-handler code here.
  *
+ * The task with the largest counter runs next, the first one on the
+ * highest list of the run queue: finding it takes a bsrl on run_bitmap,
+ * however many tasks there are.
+ *
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
  * information in task[0] is never used.
@@ -134,64 +305,48 @@ void math_state_restore()
  // 调度函数处理
 void schedule(void)
 {
-	int i,next,c;
-	struct task_struct ** p;
-
-/* check alarm, wake up any interruptible tasks that have got a signal */
+	struct task_struct * next;
+	unsigned long flags;
+	int i;
 
-	// 唤醒 触发超时或触发警告的 处于可中断睡眠状态的进程
-	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-		if (*p) {
-			// @doubt jiffies是啥意思,系统开机开始算起的嘀嗒数 (10ms 一嘀嗒)
-			// 超时计时没有超过jiffies，则重置，如果处于睡眠可中断状态，则修改为就绪状态
-			if ((*p)->timeout && (*p)->timeout < jiffies) {
-				(*p)->timeout = 0;
-				if ((*p)->state == TASK_INTERRUPTIBLE)
-					(*p)->state = TASK_RUNNING;
-			}
-			// 如果任务设置了警告，且警告小于jiffies，则设置警报信号，并清空警告值
-			if ((*p)->alarm && (*p)->alarm < jiffies) {
-				(*p)->signal |= (1<<(SIGALRM-1));
-				(*p)->alarm = 0;
-			}
-			// 可阻塞信号& 设置的要阻塞的信号 = 实际需要阻塞的信号
-			// 在排除了需要阻塞的信号后还有信号，如果处于可中断的睡眠状态，则修改为就绪状态
-			if (((*p)->signal & ~(_BLOCKABLE & (*p)->blocked)) &&
-			(*p)->state==TASK_INTERRUPTIBLE)
-				(*p)->state=TASK_RUNNING;
+	save_flags(flags);
+	cli();
+	// 带超时去睡眠: 已经超时就不睡了 否则启动超时定时器
+	if (current->state == TASK_INTERRUPTIBLE && current->timeout) {
+		if (current->timeout < jiffies) {
+			current->timeout = 0;
+			current->state = TASK_RUNNING;
+		} else {
+			current->timeout_timer.fn = task_timeout;
+			current->timeout_timer.data = (unsigned long) current;
+			start_timer(&current->timeout_timer,
+				current->timeout - jiffies + 1);
 		}
-
-/* this is the scheduler proper: */
-
-	while (1) {
-		c = -1;
-		next = 0;
-		i = NR_TASKS;
-		p = &task[NR_TASKS];
-		// 这里会默认跳过任务0的处理
-		while (--i) {
-			if (!*--p)
-				continue;
-			
-			// 找到任务是就绪状态且剩余运行时间最大的任务
-			if ((*p)->state == TASK_RUNNING && (*p)->counter > c)
-				c = (*p)->counter, next = i;
+	}
+	// 信号由发送者唤醒 这里只需看当前任务是否带着信号去睡眠
+	if (current->state == TASK_INTERRUPTIBLE)
+		signal_wake_up(current);
+	if (current->next_run)
+		dequeue_task(current);
+	if (current->state == TASK_RUNNING && current != task[0])
+		enqueue_task(current);
+	// 没有就绪任务就执行0号任务(idle)
+	if (!run_bitmap)
+		next = task[0];
+	else {
+		__asm__("bsrl %1,%0":"=r" (i):"r" (run_bitmap));
+		// 所有就绪任务的时间片都已用完 重新分配
+		if (!i) {
+			recompute_counters();
+			__asm__("bsrl %1,%0":"=r" (i):"r" (run_bitmap));
 		}
-		// 如果c==0，表示除0号外的所有就绪任务，都已调度运行完分配的时间片（嘀嗒数）
-		//		因而需要对所有任务进行重新分配时间
-		// 如果c==-1，表示没有就绪任务，执行0号任务（idle），这里假定counter>=0, 查看代码确实是
-		if (c) break;
-		
-		// 走到这里表示，已经没有可供运行的任务（比如任务的时间片用完，或者任务不是就绪状态）
-		// 对所有任务进行的时间片进行赋值
-		// counter = counter/2 + priority
-		for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-			if (*p)
-				(*p)->counter = ((*p)->counter >> 1) +
-						(*p)->priority;
+		next = run_queue[i];
+		dequeue_task(next);
 	}
 	// @doubt 切换执行任务
-	switch_to(next);
+	// 切换时中断仍关着: 队列里的任务和current要一起变 换回来时才恢复
+	switch_to(next->nr);
+	restore_flags(flags);
 }
 
 int sys_pause(void)
@@ -222,14 +377,14 @@ repeat:	schedule();
 	// 传入的指定任务不是当前任务，则设置成就绪状态
 	// 对当前任务设置成不可中断的睡眠
 	if (*p && *p != current) {
-		(**p).state = 0;
+		wake_up_process(*p);
 		current->state = TASK_UNINTERRUPTIBLE;
 		goto repeat;
 	}
 	if (!*p)
 		printk("Warning: *P = NULL\n\r");
 	if (*p = tmp)	// tmp应该没机会被改变且不为空
-		tmp->state=0;
+		wake_up_process(tmp);
 }
 
 // 对当前任务 设置可中断睡眠
@@ -252,7 +407,7 @@ void wake_up(struct task_struct **p)
 			printk("wake_up: TASK_STOPPED");
 		if ((**p).state == TASK_ZOMBIE)
 			printk("wake_up: TASK_ZOMBIE");
-		(**p).state=0;
+		wake_up_process(*p);
 	}
 }
 
@@ -262,10 +417,33 @@ void wake_up(struct task_struct **p)
  * was the easiest way of doing it.
  */
 static struct task_struct * wait_motor[4] = {NULL,NULL,NULL,NULL};
-static int  mon_timer[4]={0,0,0,0};
-static int moff_timer[4]={0,0,0,0};
+static struct timer_list mon_timer[4];		// 马达转稳的定时器
+static struct timer_list moff_timer[4];		// 关马达的定时器
 unsigned char current_DOR = 0x0C;
 
+/// 马达已转稳 唤醒等它的进程
+static void motor_on_callback(unsigned long nr)
+{
+	wake_up(nr+wait_motor);
+}
+
+/// 关掉马达
+static void motor_off_callback(unsigned long nr)
+{
+	current_DOR &= ~(0x10 << nr);
+	outb(current_DOR,FD_DOR);
+}
+
+/// 马达还要多少滴答才转稳 0表示已转稳
+static int motor_ticks(unsigned int nr)
+{
+	long ticks = mon_timer[nr].expires - jiffies;
+
+	if (!mon_timer[nr].next)
+		return 0;
+	return (ticks > 0) ? ticks : 1;
+}
+
 int ticks_to_floppy_on(unsigned int nr)
 {
 	extern unsigned char selected;
@@ -273,7 +451,7 @@ int ticks_to_floppy_on(unsigned int nr)
 
 	if (nr>3)
 		panic("floppy_on: nr>3");
-	moff_timer[nr]=10000;		/* 100 s = very big :-) */
+	start_timer(moff_timer+nr,100*HZ);	/* 100 s = very big :-) */
 	cli();				/* use floppy_off to turn it off */
 	mask |= current_DOR;
 	if (!selected) {
@@ -283,13 +461,13 @@ int ticks_to_floppy_on(unsigned int nr)
 	if (mask != current_DOR) {
 		outb(mask,FD_DOR);
 		if ((mask ^ current_DOR) & 0xf0)
-			mon_timer[nr] = HZ/2;
-		else if (mon_timer[nr] < 2)
-			mon_timer[nr] = 2;
+			start_timer(mon_timer+nr,HZ/2);
+		else if (motor_ticks(nr) < 2)
+			start_timer(mon_timer+nr,2);
 		current_DOR = mask;
 	}
 	sti();
-	return mon_timer[nr];
+	return motor_ticks(nr);
 }
 
 void floppy_on(unsigned int nr)
@@ -302,79 +480,308 @@ void floppy_on(unsigned int nr)
 
 void floppy_off(unsigned int nr)
 {
-	moff_timer[nr]=3*HZ;
+	start_timer(moff_timer+nr,3*HZ);
 }
 
-void do_floppy_timer(void)
+/*
+ * The timer wheel. A timer that expires within 256 ticks is on one of
+ * the 256 lists of tv1, by the low 8 bits of its expiry time. The later
+ * ones are on the lists of tv[0] to tv[3] (64 lists each), by the next
+ * 6 bits of their expiry time for each level. Each time the low bits
+ * of timer_jiffies go round to 0, the next list of the level above is
+ * taken apart and its timers are sorted down. So starting and stopping
+ * a timer, and expiring one, is a fixed amount of work.
+ */
+#define TVR_BITS	8
+#define TVN_BITS	6
+#define TVR_MASK	((1 << TVR_BITS) - 1)
+#define TVN_MASK	((1 << TVN_BITS) - 1)
+#define MAX_TIMER_TICKS	0x3fffffff	/* longer ones are started again */
+
+/*
+ * The list heads: a struct timer_head looks like the start of a struct
+ * timer_list, and is used as one on the lists.
+ */
+struct timer_head {
+	struct timer_list * next, * prev;
+};
+
+#define HEAD(h) ((struct timer_list *) (h))
+
+static struct timer_head tv1[1 << TVR_BITS];
+static struct timer_head tv[4][1 << TVN_BITS];
+static unsigned long timer_jiffies = 0;	// 时间轮已处理到的时刻
+
+/// 按到期时间把定时器挂到时间轮的链表上 调用时须关中断
+static void internal_add_timer(struct timer_list * t)
 {
+	unsigned long idx = t->expires - timer_jiffies;
+	struct timer_head * h;
 	int i;
-	unsigned char mask = 0x10;
-
-	for (i=0 ; i<4 ; i++,mask <<= 1) {
-		if (!(mask & current_DOR))
-			continue;
-		if (mon_timer[i]) {
-			if (!--mon_timer[i])
-				wake_up(i+wait_motor);
-		} else if (!moff_timer[i]) {
-			current_DOR &= ~mask;
-			outb(current_DOR,FD_DOR);
-		} else
-			moff_timer[i]--;
+
+	if ((long) idx < 0)		/* already due: next tick */
+		h = tv1 + (timer_jiffies & TVR_MASK);
+	else if (idx <= TVR_MASK)
+		h = tv1 + (t->expires & TVR_MASK);
+	else {
+		for (i = 0 ; i < 3 ; i++)
+			if (idx < (1UL << (TVR_BITS + (i+1)*TVN_BITS)))
+				break;
+		h = tv[i] + ((t->expires >> (TVR_BITS + i*TVN_BITS)) & TVN_MASK);
 	}
+	t->next = HEAD(h);
+	t->prev = h->prev;
+	h->prev->next = t;
+	h->prev = t;
 }
 
-#define TIME_REQUESTS 64
+/// 把定时器从链表上取下 调用时须关中断
+static void detach_timer(struct timer_list * t)
+{
+	t->next->prev = t->prev;
+	t->prev->next = t->next;
+	t->next = t->prev = NULL;
+}
 
-// 当tiemr被触发后，fn会被置空 
-// next_timer为timer的有效队列头
-static struct timer_list {
-	long jiffies;
-	void (*fn)();
-	struct timer_list * next;
-} timer_list[TIME_REQUESTS], * next_timer = NULL;
+/*
+ * Start timer, to go off in 'ticks' ticks (the next tick for 0 or 1).
+ * A timer that is pending already is moved.
+ */
+/// 启动定时器
+void start_timer(struct timer_list * timer, unsigned long ticks)
+{
+	unsigned long flags;
 
-// 新加入的timer会被放到队尾，并且其时间jiffies会依次减去排在它前面的元素的jiffies
+	save_flags(flags);
+	cli();
+	if (timer->next)
+		detach_timer(timer);
+	if (ticks > MAX_TIMER_TICKS)
+		ticks = MAX_TIMER_TICKS;
+	timer->expires = jiffies + ticks;
+	internal_add_timer(timer);
+	restore_flags(flags);
+}
 
-// 从算法描述看，传入的jiffies需要是个固定值，或者比next_timer->jiffes大才正确
-void add_timer(long jiffies, void (*fn)(void))
+/// 停止定时器 返回它是否还未到期
+int stop_timer(struct timer_list * timer)
 {
-	struct timer_list * p;
+	unsigned long flags;
+	int pending;
 
-	if (!fn)
+	save_flags(flags);
+	cli();
+	if (pending = (timer->next != NULL))
+		detach_timer(timer);
+	restore_flags(flags);
+	return pending;
+}
+
+/// 把一条链表上的定时器重新按到期时间挂到下一层
+static void cascade(struct timer_head * h)
+{
+	struct timer_list * t;
+
+	while ((t = h->next) != HEAD(h)) {
+		detach_timer(t);
+		internal_add_timer(t);
+	}
+}
+
+/*
+ * Called from do_timer(), with interrupts off: run the timers that are
+ * due. A timer function may turn interrupts on, so this must keep
+ * another timer interrupt from coming in here too - it'll find that the
+ * work has been done.
+ */
+/// 处理到期的定时器
+static void run_timers(void)
+{
+	static int running = 0;
+	struct timer_head * h;
+	struct timer_list * t;
+	int i, idx;
+
+	if (running)
 		return;
+	running = 1;
+	while ((long) (jiffies - timer_jiffies) >= 0) {
+		// 低位转了一圈 把上一层的下一条链表分下来
+		if (!(timer_jiffies & TVR_MASK))
+			for (i = 0 ; i < 4 ; i++) {
+				idx = (timer_jiffies >> (TVR_BITS + i*TVN_BITS)) & TVN_MASK;
+				cascade(tv[i] + idx);
+				if (idx)
+					break;
+			}
+		h = tv1 + (timer_jiffies & TVR_MASK);
+		while ((t = h->next) != HEAD(h)) {
+			detach_timer(t);
+			(t->fn)(t->data);
+			cli();
+		}
+		timer_jiffies++;
+	}
+	running = 0;
+}
+
+/*
+ * add_timer() is for those that just want fn() called in 'jiffies'
+ * ticks, and have no struct timer_list of their own: it takes a time
+ * request from a pool, and starts the timer in it. The pool is the
+ * TIME_REQUESTS static ones, and grows a page at a time when they are
+ * used up, to at most MAX_TIME_PAGES pages.
+ *
+ * The handle add_timer() returns is for del_timer(). Its low TR_BITS
+ * bits are the index of the request, plus one, the others a sequence
+ * number: a handle whose request has gone off, and maybe been used
+ * again since, doesn't match it any more.
+ */
+#define TIME_REQUESTS	64
+#define MAX_TIME_PAGES	4
+#define TR_PER_PAGE	(PAGE_SIZE/sizeof(struct time_request))
+#define TR_BITS		12
+#define TR_MASK		((1 << TR_BITS) - 1)
+
+struct time_request {
+	struct timer_list timer;
+	void (*fn)(void);
+	int handle;							// 0表示空闲
+	int index;							// 在池中的序号
+	struct time_request * next_free;
+};
+
+static struct time_request time_requests[TIME_REQUESTS];
+static struct time_request * time_pages[MAX_TIME_PAGES];
+static int nr_time_pages = 0;
+static struct time_request * free_requests = NULL;
+static int time_seq = 0;
+
+/// 把time request放回空闲链表 调用时须关中断
+static void put_time_request(struct time_request * p)
+{
+	p->handle = 0;
+	p->next_free = free_requests;
+	free_requests = p;
+}
+
+/// 把从序号index开始的nr个time request加入池中 调用时须关中断
+static void add_time_requests(struct time_request * p, int index, int nr)
+{
+	for ( ; nr > 0 ; nr--,p++) {
+		p->index = index++;
+		put_time_request(p);
+	}
+}
+
+/// 给time request池增加一页 调用时须关中断
+static int grow_time_requests(void)
+{
+	unsigned long page;
+
+	if (nr_time_pages >= MAX_TIME_PAGES || !(page = get_free_page()))
+		return 0;
+	time_pages[nr_time_pages] = (struct time_request *) page;
+	add_time_requests(time_pages[nr_time_pages],
+		TIME_REQUESTS + nr_time_pages*TR_PER_PAGE,TR_PER_PAGE);
+	nr_time_pages++;
+	return 1;
+}
+
+/// 由句柄找到它的time request 句柄已失效返回NULL
+static struct time_request * handle_request(int handle)
+{
+	struct time_request * p;
+	int i = (handle & TR_MASK) - 1;
+
+	if (i < 0)
+		return NULL;
+	if (i < TIME_REQUESTS)
+		p = time_requests + i;
+	else if ((i -= TIME_REQUESTS) / TR_PER_PAGE < nr_time_pages)
+		p = time_pages[i / TR_PER_PAGE] + i % TR_PER_PAGE;
+	else
+		return NULL;
+	return (p->handle == handle) ? p : NULL;
+}
+
+/// time request的定时器到时 先把它放回池中再调用fn
+static void time_request_fn(unsigned long data)
+{
+	struct time_request * p = (struct time_request *) data;
+	void (*fn)(void) = p->fn;
+
+	put_time_request(p);
+	(fn)();
+}
+
+/*
+ * Have fn() called from the timer interrupt in 'jiffies' ticks, or now
+ * if that is 0 or less. Returns the handle, 0 if called at once - or if
+ * there was no memory for the request, which is the only way it can
+ * fail.
+ */
+int add_timer(long jiffies, void (*fn)(void))
+{
+	struct time_request * p;
+	unsigned long flags;
+	int handle = 0;
+
+	if (!fn)
+		return 0;
+	save_flags(flags);
 	cli();
 	if (jiffies <= 0)
 		(fn)();
+	else if (!free_requests && !grow_time_requests())
+		printk("add_timer: no free time requests\n\r");
 	else {
-		// 找到可设置的timer的结构
-		for (p = timer_list ; p < timer_list + TIME_REQUESTS ; p++)
-			if (!p->fn)
-				break;
-		if (p >= timer_list + TIME_REQUESTS)
-			panic("No more time requests free");
-
+		p = free_requests;
+		free_requests = p->next_free;
+		time_seq = (time_seq + 1) & (0x7fffffff >> TR_BITS);
+		handle = p->handle = (time_seq << TR_BITS) | (p->index + 1);
 		p->fn = fn;
-		p->jiffies = jiffies;
-		p->next = next_timer;
-		next_timer = p;
-
-		// next_timer 可理解为list的队头，当插入新的timer后，会根据next链条一直处理到尾部
-		// 每个当前p会与它的下一个节点交换（如果jiffies值比他大），并把它的jiffies减掉它的父节点，最终队尾的有可能为负数
-		//	如果新加入的节点 jiffies 小于当前的队头节点的jiffies，逻辑就不对了  @doubt-bug
-		while (p->next && p->next->jiffies < p->jiffies) {
-			p->jiffies -= p->next->jiffies;
-			// 这里已经开始交换timer
-			fn = p->fn;
-			p->fn = p->next->fn;
-			p->next->fn = fn;
-			jiffies = p->jiffies;
-			p->jiffies = p->next->jiffies;
-			p->next->jiffies = jiffies;
-			p = p->next;
-		}
+		p->timer.fn = time_request_fn;
+		p->timer.data = (unsigned long) p;
+		start_timer(&p->timer,jiffies);
+	}
+	restore_flags(flags);
+	return handle;
+}
+
+/// 取消add_timer()启动的定时器 返回它是否还未到期
+int del_timer(int handle)
+{
+	struct time_request * p;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (p = handle_request(handle)) {
+		stop_timer(&p->timer);
+		put_time_request(p);
+	}
+	restore_flags(flags);
+	return p != NULL;
+}
+
+/// 初始化时间轮的链表头 time request池和软驱马达的定时器
+static void init_timers(void)
+{
+	int i, j;
+
+	for (i = 0 ; i < (1 << TVR_BITS) ; i++)
+		tv1[i].next = tv1[i].prev = HEAD(tv1+i);
+	for (i = 0 ; i < 4 ; i++)
+		for (j = 0 ; j < (1 << TVN_BITS) ; j++)
+			tv[i][j].next = tv[i][j].prev = HEAD(tv[i]+j);
+	timer_jiffies = jiffies;
+	add_time_requests(time_requests,0,TIME_REQUESTS);
+	for (i = 0 ; i < 4 ; i++) {
+		mon_timer[i].fn = motor_on_callback;
+		moff_timer[i].fn = motor_off_callback;
+		mon_timer[i].data = moff_timer[i].data = i;
 	}
-	sti();
 }
 
 void do_timer(long cpl)
@@ -391,9 +798,6 @@ void do_timer(long cpl)
 		blank_screen();
 		blanked = 1;
 	}
-	if (hd_timeout)
-		if (!--hd_timeout)
-			hd_times_out();
 
 	if (beepcount)
 		if (!--beepcount)
@@ -404,21 +808,7 @@ void do_timer(long cpl)
 	else
 		current->stime++;
 
-	if (next_timer) {
-		// 如果有timer队列
-		// 调度执行所有jiffies<=0的
-		next_timer->jiffies--;
-		while (next_timer && next_timer->jiffies <= 0) {
-			void (*fn)(void);
-			
-			fn = next_timer->fn;
-			next_timer->fn = NULL;
-			next_timer = next_timer->next;
-			(fn)();
-		}
-	}
-	if (current_DOR & 0xf0)
-		do_floppy_timer();
+	run_timers();
 	if ((--current->counter)>0) return;
 	current->counter=0;
 	if (!cpl) return;
@@ -432,6 +822,12 @@ int sys_alarm(long seconds)
 	if (old)
 		old = (old - jiffies) / HZ;	// 需要换成时间  嘀嗒数*每嘀嗒时间（0.01秒）
 	current->alarm = (seconds>0)?(jiffies+HZ*seconds):0;
+	if (current->alarm) {
+		current->alarm_timer.fn = task_alarm;
+		current->alarm_timer.data = (unsigned long) current;
+		start_timer(&current->alarm_timer,current->alarm - jiffies + 1);
+	} else
+		stop_timer(&current->alarm_timer);
 	return (old);
 }
 
@@ -491,6 +887,7 @@ void sched_init(void)
 	
 	// 在全局描述表gdt中设置0号任务的任务状态信息和局部描述符表信息
 	// gdt实际定义在head.s 中的_gdt 
+	init_timers();
 	set_tss_desc(gdt+FIRST_TSS_ENTRY,&(init_task.task.tss));
 	set_ldt_desc(gdt+FIRST_LDT_ENTRY,&(init_task.task.ldt));
 	p = gdt+2+FIRST_TSS_ENTRY;
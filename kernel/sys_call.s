@@ -69,7 +69,7 @@ ENOSYS = 38
  * strange reason. Urgel. Now I just ignore them.
  */
 .globl _system_call,_sys_fork,_timer_interrupt,_sys_execve
-.globl _hd_interrupt,_floppy_interrupt,_parallel_interrupt
+.globl _hd_interrupt,_hd2_interrupt,_floppy_interrupt,_parallel_interrupt
 .globl _device_not_available, _coprocessor_error
 
 .align 2
@@ -237,6 +237,14 @@ _hd_interrupt:
 	pushl %eax
 	pushl %ecx
 	pushl %edx
+	xorl %edx,%edx		# primary channel
+	jmp hd_common
+_hd2_interrupt:
+	pushl %eax
+	pushl %ecx
+	pushl %edx
+	movl $1,%edx		# secondary channel
+hd_common:
 	push %ds
 	push %es
 	push %fs
@@ -249,14 +257,10 @@ _hd_interrupt:
 	outb %al,$0xA0		# EOI to interrupt controller #1
 	jmp 1f			# give port chance to breathe
 1:	jmp 1f
-1:	xorl %edx,%edx
-	movl %edx,_hd_timeout
-	xchgl _do_hd,%edx
-	testl %edx,%edx
-	jne 1f
-	movl $_unexpected_hd_interrupt,%edx
 1:	outb %al,$0x20
-	call *%edx		# "interesting" way of handling intr.
+	pushl %edx
+	call _hd_intr		# hd_intr(channel)
+	addl $4,%esp
 	pop %fs
 	pop %es
 	pop %ds
@@ -499,4 +499,5 @@ void show_mem(void)
 		}
 	}
 	printk("Memory found: %d (%d)\n\r",free-shared,total);
+	show_buffers();
 }
@@ -0,0 +1,143 @@
+/*
+ *  linux/tools/rdlz.c
+ */
+
+/*
+ * This file compresses a file system image for the ram disk, in the
+ * format rd_load() in kernel/blk_drv/ramdisk.c understands. It reads the
+ * image from stdin and writes to stdout one block of header followed by
+ * the compressed data, to be put at block 256 of the boot floppy:
+ *
+ *	rdlz < rootimage | dd of=/dev/PS0 bs=1024 seek=256
+ */
+
+#include <stdio.h>	/* fprintf */
+#include <string.h>
+#include <stdlib.h>	/* contains exit, malloc */
+
+#define RD_LZ_MAGIC	0x5a4c4452	/* "RDLZ" */
+
+#define WINDOW		4096		/* matches go at most this far back */
+#define MIN_MATCH	3
+#define MAX_MATCH	18
+#define MAX_CHAIN	256		/* match candidates tried per byte */
+#define HASH_SIZE	4096
+
+#define HASH(p) ((((p)[0] << 8) ^ ((p)[1] << 4) ^ (p)[2]) & (HASH_SIZE-1))
+
+static unsigned char * in, * out;
+static long size, csize;
+static long head[HASH_SIZE], * prev;
+
+void die(char * str)
+{
+	fprintf(stderr,"%s\n",str);
+	exit(1);
+}
+
+static void read_image(void)
+{
+	long n, max = 64*1024;
+
+	if (!(in = malloc(max)))
+		die("Out of memory");
+	while ((n = fread(in+size,1,max-size,stdin)) > 0)
+		if ((size += n) == max && !(in = realloc(in,max *= 2)))
+			die("Out of memory");
+	if (ferror(stdin))
+		die("Unable to read image");
+	if (!size)
+		die("Empty image");
+}
+
+/* chain position p into the hash table, for later matches to find */
+static void insert(long p)
+{
+	long h;
+
+	if (p + MIN_MATCH > size)
+		return;
+	h = HASH(in+p);
+	prev[p] = head[h];
+	head[h] = p;
+}
+
+/* longest match for position p, its offset in *off */
+static int longest(long p, long * off)
+{
+	long q;
+	int len, best = 0, chain = MAX_CHAIN;
+
+	if (p + MIN_MATCH > size)
+		return 0;
+	for (q = head[HASH(in+p)] ; q >= 0 && p-q <= WINDOW && chain-- ;
+	     q = prev[q]) {
+		for (len = 0 ; len < MAX_MATCH && p+len < size ; len++)
+			if (in[q+len] != in[p+len])
+				break;
+		if (len > best) {
+			best = len;
+			*off = p-q;
+			if (len == MAX_MATCH)
+				break;
+		}
+	}
+	return best;
+}
+
+static void compress(void)
+{
+	long p = 0, off, flagpos, i;
+	int len, item = 8;
+
+	if (!(out = malloc(size + size/8 + 1)) ||
+	    !(prev = malloc(size * sizeof(long))))
+		die("Out of memory");
+	for (i = 0 ; i < HASH_SIZE ; i++)
+		head[i] = -1;
+	while (p < size) {
+		if (item == 8) {
+			flagpos = csize++;
+			out[flagpos] = 0;
+			item = 0;
+		}
+		if ((len = longest(p,&off)) >= MIN_MATCH) {
+			off--;
+			out[csize++] = off & 0xff;
+			out[csize++] = ((off >> 4) & 0xf0) | (len - MIN_MATCH);
+		} else {
+			len = 1;
+			out[flagpos] |= 1 << item;
+			out[csize++] = in[p];
+		}
+		item++;
+		while (len--)
+			insert(p++);
+	}
+}
+
+/* the header is three longs as the (i386) kernel sees them */
+static void put_long(unsigned char * p, unsigned long n)
+{
+	p[0] = n; p[1] = n >> 8; p[2] = n >> 16; p[3] = n >> 24;
+}
+
+int main(int argc, char ** argv)
+{
+	unsigned char block[1024];
+
+	if (argc != 1)
+		die("Usage: rdlz < image > compressed-image");
+	read_image();
+	compress();
+	memset(block,0,sizeof(block));
+	put_long(block,RD_LZ_MAGIC);
+	put_long(block+4,size);
+	put_long(block+8,csize);
+	if (fwrite(block,1,sizeof(block),stdout) != sizeof(block) ||
+	    fwrite(out,1,csize,stdout) != csize)
+		die("Write call failed");
+	fprintf(stderr,"Image: %ld bytes, compressed %ld bytes (%ld blocks).\n",
+		size,csize,(csize+1023)/1024);
+	return 0;
+}